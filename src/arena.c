@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "array.h"
+#include "must.h"
+
+// Returns size rounded up to a whole number of ARENA_ALIGN units, at least one.
+static size_t aligned_size(size_t size) {
+	return size == 0 ? ARENA_ALIGN : (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+arena_t new_arena(size_t capacity) {
+	capacity = aligned_size(capacity);
+	return (arena_t){
+		.block = must_aligned_alloc(ARENA_ALIGN, capacity),
+		.capacity = capacity,
+	};
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+	size = aligned_size(size);
+	if (arena->used + size > arena->capacity) {
+		void* p = must_aligned_alloc(ARENA_ALIGN, size);
+		array_push(arena->overflow, p);
+		arena->overflow_size += size;
+		return p;
+	}
+
+	void* p = arena->block + arena->used;
+	arena->used += size;
+	arena->last = p;
+	return p;
+}
+
+void* arena_grow(arena_t* arena, void* p, size_t old_size, size_t new_size) {
+	if (p != NULL && p == arena->last) {
+		size_t offset = (char*)p - arena->block;
+		size_t size = aligned_size(new_size);
+		if (offset + size <= arena->capacity) {
+			arena->used = offset + size;
+			return p;
+		}
+	}
+
+	void* grown = arena_alloc(arena, new_size);
+	if (old_size > 0) {
+		memcpy(grown, p, old_size);
+	}
+	return grown;
+}
+
+void arena_reset(arena_t* arena) {
+	int n_overflow = array_len(arena->overflow);
+	if (n_overflow > 0) {
+		for (int i = 0; i < n_overflow; i++) {
+			free(arena->overflow[i]);
+		}
+		size_t capacity = arena->used + arena->overflow_size;
+		free(arena->block);
+		arena->block = must_aligned_alloc(ARENA_ALIGN, capacity);
+		arena->capacity = capacity;
+		arena->overflow = array_reset(arena->overflow, sizeof(void*));
+		arena->overflow_size = 0;
+	}
+	arena->used = 0;
+	arena->last = NULL;
+}
+
+void arena_free(arena_t* arena) {
+	for (int i = 0; i < array_len(arena->overflow); i++) {
+		free(arena->overflow[i]);
+	}
+	array_free(arena->overflow);
+	free(arena->block);
+	*arena = (arena_t){ 0 };
+}
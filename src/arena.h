@@ -0,0 +1,51 @@
+// arena.h provides a linear allocator for data that lives no longer than a frame, which hands out
+// memory by advancing an offset through a block and frees all of it at once.
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Alignment of every allocation in bytes, which suits SIMD loads and stores as well as any struct.
+#define ARENA_ALIGN 32
+
+/*
+Structs
+*/
+
+// arena_t allocates from a single block of memory. Allocations that don't fit in the block are
+// given blocks of their own until the next reset, which replaces the block with one large enough
+// for everything allocated since the last reset. Once the arena has seen its busiest frame, it
+// never calls malloc again.
+typedef struct arena_t {
+	char* block;
+	size_t capacity;
+	size_t used;
+	void* last; // the most recent allocation from the block, which may grow in place, or NULL
+	void** overflow; // dynamic array of blocks allocated since the last reset
+	size_t overflow_size; // total size of the overflow blocks
+} arena_t;
+
+/*
+Functions
+*/
+
+// Construct an arena whose block holds capacity bytes.
+arena_t new_arena(size_t capacity);
+
+// Returns size bytes of uninitialized memory aligned to ARENA_ALIGN, valid until the arena is next
+// reset. Allocation is not thread-safe.
+void* arena_alloc(arena_t* arena, size_t size);
+
+// Returns new_size bytes beginning with the old_size bytes at p, which must have been allocated
+// from the arena since its last reset, or be NULL. The most recent allocation grows in place where
+// the block has room; others are copied.
+void* arena_grow(arena_t* arena, void* p, size_t old_size, size_t new_size);
+
+// Frees everything allocated from the arena in constant time, unless allocations overflowed the
+// block, in which case the block is first replaced by a larger one.
+void arena_reset(arena_t* arena);
+
+// Free the memory associated with the arena, after which it must not be used.
+void arena_free(arena_t* arena);
+
+#endif
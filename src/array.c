@@ -40,6 +40,11 @@ int array_len(void* array) {
 	return (array != NULL) ? ARRAY_LEN(array) : 0;
 }
 
+void array_write_header(void* dst, int len) {
+	int header[2] = { len, len }; // capacity, len
+	memcpy(dst, header, ARRAY_HEADER_SIZE);
+}
+
 void* array_reset(void* array, size_t item_size) {
 	if (array == NULL) {
 		return NULL;
@@ -49,6 +54,10 @@ void* array_reset(void* array, size_t item_size) {
 	return array;
 }
 
+void array_pop(void* array) {
+	ARRAY_LEN(array)--;
+}
+
 void array_free(void* array) {
 	if (array != NULL) {
 		free(ARRAY_RAW_DATA(array));
@@ -2,6 +2,11 @@
 #ifndef ARRAY_H
 #define ARRAY_H
 
+#include <stddef.h>
+
+// Size in bytes of the header that precedes the elements of every array.
+#define ARRAY_HEADER_SIZE (sizeof(int) * 2)
+
 // Push an element onto the array. If sufficient space is unavailable, the array is transparently
 // resized.
 #define array_push(array, value)                                              \
@@ -16,9 +21,17 @@ void* array_hold(void* array, int count, size_t item_size);
 
 int array_len(void* array);
 
+// array_write_header writes the header of a full array of len elements to the ARRAY_HEADER_SIZE bytes
+// at dst. Elements that directly follow such a header in memory not allocated by array_hold, such as
+// a mapped file, may then be read as an array, but must never be pushed to or freed.
+void array_write_header(void* dst, int len);
+
 // array_reset resets the array's length without freeing memory, effectively emptying the array.
 void* array_reset(void* array, size_t item_size);
 
+// array_pop removes the last element of the array, which must not be empty.
+void array_pop(void* array);
+
 // array_free frees the memory associated with the array, after which it must not be used.
 void array_free(void* array);
 
@@ -0,0 +1,369 @@
+#include <stdlib.h>
+
+#include "array.h"
+#include "bsp.h"
+#include "mesh.h"
+
+// Distance from a plane, relative to the size of the mesh, within which a vertex is considered to lie
+// on the plane.
+#define BSP_PLANE_EPSILON 1e-5f
+
+// Number of candidate splitting planes evaluated per node.
+#define BSP_SPLITTER_CANDIDATES 8
+
+// Maximum number of faces classified against each candidate plane when scoring it.
+#define BSP_SCORE_SAMPLES 256
+
+// Cost of a split relative to one face of imbalance between the front and back subtrees.
+#define BSP_SPLIT_COST 8
+
+typedef enum bsp_side_t {
+	BSP_SIDE_ON,
+	BSP_SIDE_FRONT,
+	BSP_SIDE_BACK,
+	BSP_SIDE_SPANNING,
+} bsp_side_t;
+
+typedef struct bsp_plane_t {
+	vec3_t normal;
+	float d;
+} bsp_plane_t;
+
+// bsp_corner_t is a polygon vertex expressed as 0-based mesh vertex and tex coord indices.
+typedef struct bsp_corner_t {
+	uint32_t vertex;
+	uint32_t uv;
+} bsp_corner_t;
+
+typedef struct bsp_builder_t {
+	bsp_tree_t* tree;
+	mesh_t* mesh;
+	float epsilon;
+} bsp_builder_t;
+
+static vec3_t face_vertex(const mesh_t* mesh, const mesh_face_t* f, int i) {
+	uint32_t index = i == 0 ? f->a : i == 1 ? f->b : f->c;
+	return mesh->vertices[index];
+}
+
+// Returns false if the face is too small to define a plane. The front of the plane is the front of
+// the face.
+static bool face_plane(const mesh_t* mesh, int face_index, bsp_plane_t* plane) {
+	const mesh_face_t* f = &mesh->faces[face_index];
+	vec3_t normal = mesh_face_normal(mesh, f);
+	if (normal.x == 0 && normal.y == 0 && normal.z == 0) {
+		return false;
+	}
+
+	vec3_t a = face_vertex(mesh, f, 0);
+	plane->normal = normal;
+	plane->d = vec3_dot(&normal, &a);
+	return true;
+}
+
+static bsp_side_t classify_face(const bsp_builder_t* b, const bsp_plane_t* plane, int face_index, float dist[3]) {
+	const mesh_face_t* f = &b->mesh->faces[face_index];
+	bool front = false;
+	bool back = false;
+	for (int i = 0; i < 3; i++) {
+		vec3_t v = face_vertex(b->mesh, f, i);
+		dist[i] = vec3_dot(&plane->normal, &v) - plane->d;
+		front |= dist[i] > b->epsilon;
+		back |= dist[i] < -b->epsilon;
+	}
+
+	if (front && back) {
+		return BSP_SIDE_SPANNING;
+	} else if (front) {
+		return BSP_SIDE_FRONT;
+	} else if (back) {
+		return BSP_SIDE_BACK;
+	}
+	return BSP_SIDE_ON;
+}
+
+// choose_splitter scores the planes of a few faces spread evenly through the list by the number of
+// splits and the imbalance they would cause, returning false if no face defines a plane.
+static bool choose_splitter(const bsp_builder_t* b, const int* faces, bsp_plane_t* best) {
+	int n = array_len((void*)faces);
+	int candidate_step = n > BSP_SPLITTER_CANDIDATES ? n / BSP_SPLITTER_CANDIDATES : 1;
+	int sample_step = n > BSP_SCORE_SAMPLES ? n / BSP_SCORE_SAMPLES : 1;
+	int best_score = -1;
+	for (int i = 0; i < n; i += candidate_step) {
+		bsp_plane_t plane;
+		if (!face_plane(b->mesh, faces[i], &plane)) {
+			continue;
+		}
+
+		int n_front = 0, n_back = 0, n_split = 0;
+		for (int j = 0; j < n; j += sample_step) {
+			float dist[3];
+			switch (classify_face(b, &plane, faces[j], dist)) {
+			case BSP_SIDE_FRONT:
+				n_front++;
+				break;
+			case BSP_SIDE_BACK:
+				n_back++;
+				break;
+			case BSP_SIDE_SPANNING:
+				n_split++;
+				break;
+			default:
+				break;
+			}
+		}
+
+		int score = n_split * BSP_SPLIT_COST + abs(n_front - n_back);
+		if (best_score < 0 || score < best_score) {
+			best_score = score;
+			*best = plane;
+		}
+	}
+
+	return best_score >= 0;
+}
+
+// Appends the point at parameter t along the edge from corner p to corner q to the mesh.
+static bsp_corner_t interpolate_corner(mesh_t* mesh, bsp_corner_t p, bsp_corner_t q, float t) {
+	vec3_t pv = mesh->vertices[p.vertex];
+	vec3_t qv = mesh->vertices[q.vertex];
+	vec3_t v = {
+		.x = pv.x + (qv.x - pv.x) * t,
+		.y = pv.y + (qv.y - pv.y) * t,
+		.z = pv.z + (qv.z - pv.z) * t,
+	};
+	tex2_t puv = mesh->tex_coords[p.uv];
+	tex2_t quv = mesh->tex_coords[q.uv];
+	tex2_t uv = {
+		.u = puv.u + (quv.u - puv.u) * t,
+		.v = puv.v + (quv.v - puv.v) * t,
+	};
+
+	array_push(mesh->vertices, v);
+	array_push(mesh->tex_coords, uv);
+	return (bsp_corner_t){ .vertex = array_len(mesh->vertices) - 1, .uv = array_len(mesh->tex_coords) - 1 };
+}
+
+// Writes the fan triangulation of the polygon to the mesh, reusing face_index for the first triangle
+// if reuse is set, and pushes the index of each resulting face to the list.
+static int* emit_polygon(mesh_t* mesh, int face_index, bool reuse, const bsp_corner_t* poly, int n, int* list) {
+	for (int i = 1; i + 1 < n; i++) {
+		mesh_face_t f = { poly[0].vertex, poly[i].vertex, poly[i + 1].vertex };
+		mesh_face_t uvs = { poly[0].uv, poly[i].uv, poly[i + 1].uv };
+
+		int index = face_index;
+		if (reuse) {
+			mesh->faces[face_index] = f;
+			mesh->face_uvs[face_index] = uvs;
+			reuse = false;
+		} else {
+			array_push(mesh->faces, f);
+			array_push(mesh->face_uvs, uvs);
+			index = array_len(mesh->faces) - 1;
+		}
+		array_push(list, index);
+	}
+	return list;
+}
+
+// split_face clips a spanning face against the plane, replacing it with the fragments in front of the
+// plane and appending those behind it to the mesh. Vertices lying on the plane belong to both sides.
+static void split_face(bsp_builder_t* b, int face_index, const float dist[3], int** front, int** back) {
+	const mesh_face_t* f = &b->mesh->faces[face_index];
+	const mesh_face_t* uvs = &b->mesh->face_uvs[face_index];
+	bsp_corner_t corners[3] = {
+		{ f->a, uvs->a },
+		{ f->b, uvs->b },
+		{ f->c, uvs->c },
+	};
+
+	bsp_corner_t front_poly[4], back_poly[4];
+	int n_front = 0, n_back = 0;
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		if (dist[i] >= -b->epsilon) {
+			front_poly[n_front++] = corners[i];
+		}
+		if (dist[i] <= b->epsilon) {
+			back_poly[n_back++] = corners[i];
+		}
+		if ((dist[i] > b->epsilon && dist[j] < -b->epsilon) || (dist[i] < -b->epsilon && dist[j] > b->epsilon)) {
+			float t = dist[i] / (dist[i] - dist[j]);
+			bsp_corner_t intersection = interpolate_corner(b->mesh, corners[i], corners[j], t);
+			front_poly[n_front++] = intersection;
+			back_poly[n_back++] = intersection;
+		}
+	}
+
+	*front = emit_polygon(b->mesh, face_index, true, front_poly, n_front, *front);
+	*back = emit_polygon(b->mesh, face_index, false, back_poly, n_back, *back);
+}
+
+// bsp_pending_t is a list of faces waiting to be partitioned into a subtree of the node at parent.
+typedef struct bsp_pending_t {
+	int* faces; // dynamic array
+	int parent; // index of the parent in the tree's nodes, or -1 for the root
+	bool is_front; // true if the subtree is the parent's front child
+	int depth; // number of nodes from the root to the subtree's root, inclusive
+} bsp_pending_t;
+
+// build_node partitions the faces, which it takes ownership of, returning the index of the new node
+// and handing the faces in front of and behind it back through front and back.
+static int build_node(bsp_builder_t* b, int* faces, int** front, int** back) {
+	int n = array_len(faces);
+	bsp_node_t node = {
+		.normal = { 0, 0, 0 },
+		.d = 0,
+		.front = -1,
+		.back = -1,
+		.first_face = array_len(b->tree->faces),
+		.n_faces = 0,
+	};
+	bsp_plane_t plane;
+	if (choose_splitter(b, faces, &plane)) {
+		node.normal = plane.normal;
+		node.d = plane.d;
+		for (int i = 0; i < n; i++) {
+			float dist[3];
+			switch (classify_face(b, &plane, faces[i], dist)) {
+			case BSP_SIDE_FRONT:
+				array_push(*front, faces[i]);
+				break;
+			case BSP_SIDE_BACK:
+				array_push(*back, faces[i]);
+				break;
+			case BSP_SIDE_SPANNING:
+				split_face(b, faces[i], dist, front, back);
+				break;
+			default:
+				array_push(b->tree->faces, faces[i]);
+				break;
+			}
+		}
+	} else {
+		// None of the faces has any area, so there is nothing to order them by.
+		for (int i = 0; i < n; i++) {
+			array_push(b->tree->faces, faces[i]);
+		}
+	}
+	array_free(faces);
+	node.n_faces = array_len(b->tree->faces) - node.first_face;
+	array_push(b->tree->nodes, node);
+	return array_len(b->tree->nodes) - 1;
+}
+
+void bsp_build(bsp_tree_t* tree, mesh_t* mesh) {
+	bsp_free(tree);
+
+	float extent = mesh_extent(mesh);
+	bsp_builder_t b = {
+		.tree = tree,
+		.mesh = mesh,
+		.epsilon = BSP_PLANE_EPSILON * (extent > 0 ? extent : 1),
+	};
+	int* faces = NULL;
+	int n_faces = array_len(mesh->faces);
+	for (int i = 0; i < n_faces; i++) {
+		array_push(faces, i);
+	}
+
+	// Subtrees are built from an explicit stack rather than by recursion, since the tree of a nearly
+	// convex mesh degenerates into a chain as deep as the mesh has faces. Front subtrees are built
+	// before back subtrees, so nodes are stored in depth-first order.
+	bsp_pending_t* stack = NULL;
+	bsp_pending_t root = { .faces = faces, .parent = -1, .is_front = false, .depth = 1 };
+	array_push(stack, root);
+	bool is_too_deep = false;
+	while (array_len(stack) > 0) {
+		bsp_pending_t pending = stack[array_len(stack) - 1];
+		array_pop(stack);
+		if (array_len(pending.faces) == 0) {
+			array_free(pending.faces);
+			continue;
+		}
+		if (pending.depth > BSP_MAX_DEPTH) {
+			array_free(pending.faces);
+			is_too_deep = true;
+			break;
+		}
+
+		int* front = NULL;
+		int* back = NULL;
+		int index = build_node(&b, pending.faces, &front, &back);
+		if (pending.parent < 0) {
+			tree->root = index;
+		} else if (pending.is_front) {
+			tree->nodes[pending.parent].front = index;
+		} else {
+			tree->nodes[pending.parent].back = index;
+		}
+
+		bsp_pending_t back_pending = { .faces = back, .parent = index, .is_front = false, .depth = pending.depth + 1 };
+		bsp_pending_t front_pending = { .faces = front, .parent = index, .is_front = true, .depth = pending.depth + 1 };
+		array_push(stack, back_pending);
+		array_push(stack, front_pending);
+	}
+	int n_pending = array_len(stack);
+	for (int i = 0; i < n_pending; i++) {
+		array_free(stack[i].faces);
+	}
+	array_free(stack);
+
+	// A tree that deep would cost quadratic time to finish, so the build is abandoned as soon as it
+	// gets there and the mesh is depth sorted instead. The faces already split still describe the same
+	// surface.
+	if (is_too_deep) {
+		bsp_free(tree);
+	}
+}
+
+bool bsp_is_built(const bsp_tree_t* tree) {
+	return tree->root >= 0;
+}
+
+// bsp_visit_t is a step of a back-to-front traversal: either visiting the subtree rooted at node, or
+// writing the faces of the node itself.
+typedef struct bsp_visit_t {
+	int node;
+	bool is_emit;
+} bsp_visit_t;
+
+int bsp_back_to_front(const bsp_tree_t* tree, vec3_t eye, int* order) {
+	// Each level of the tree leaves at most its node's faces and its near subtree on the stack.
+	bsp_visit_t stack[2 * BSP_MAX_DEPTH + 1];
+	int n_stack = 0;
+	int n_ordered = 0;
+	stack[n_stack++] = (bsp_visit_t){ .node = tree->root, .is_emit = false };
+	while (n_stack > 0) {
+		bsp_visit_t visit = stack[--n_stack];
+		if (visit.node < 0) {
+			continue;
+		}
+
+		const bsp_node_t* node = &tree->nodes[visit.node];
+		if (visit.is_emit) {
+			for (int i = 0; i < node->n_faces; i++) {
+				order[n_ordered++] = tree->faces[node->first_face + i];
+			}
+			continue;
+		}
+
+		// Whatever lies on the same side of the plane as the eye may occlude the node's faces, and the
+		// node's faces may occlude whatever lies on the far side, so the far side is drawn first.
+		bool eye_in_front = vec3_dot(&node->normal, &eye) >= node->d;
+		int near = eye_in_front ? node->front : node->back;
+		int far = eye_in_front ? node->back : node->front;
+		stack[n_stack++] = (bsp_visit_t){ .node = near, .is_emit = false };
+		stack[n_stack++] = (bsp_visit_t){ .node = visit.node, .is_emit = true };
+		stack[n_stack++] = (bsp_visit_t){ .node = far, .is_emit = false };
+	}
+	return n_ordered;
+}
+
+void bsp_free(bsp_tree_t* tree) {
+	array_free(tree->nodes);
+	array_free(tree->faces);
+	tree->nodes = NULL;
+	tree->faces = NULL;
+	tree->root = -1;
+}
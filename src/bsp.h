@@ -0,0 +1,58 @@
+// bsp.h provides a binary space partitioning tree over the faces of a rigid mesh, which yields an
+// exact back-to-front ordering of the faces from any viewpoint without sorting.
+#ifndef BSP_H
+#define BSP_H
+
+#include <stdbool.h>
+
+#include "vector.h"
+
+struct mesh_t;
+
+// Maximum number of nodes on any path from the root of a tree to a leaf.
+#define BSP_MAX_DEPTH 1024
+
+/*
+Structs
+*/
+
+// bsp_node_t partitions space by the plane of one of the mesh's faces. Faces lying in that plane are
+// stored with the node, while faces in front of and behind the plane belong to its children.
+typedef struct bsp_node_t {
+	vec3_t normal;
+	float d; // the plane contains all points p where dot(normal, p) == d
+	int front; // index of the front child in the tree's nodes, or -1
+	int back; // index of the back child in the tree's nodes, or -1
+	int first_face; // index of the node's first face in the tree's faces
+	int n_faces;
+} bsp_node_t;
+
+// bsp_tree_t stores its nodes and the mesh face indices they reference in flat arrays.
+typedef struct bsp_tree_t {
+	bsp_node_t* nodes; // dynamic array
+	int* faces; // dynamic array of mesh face indices, grouped by node
+	int root; // index of the root node, or -1 if the tree is empty
+} bsp_tree_t;
+
+/*
+Functions
+*/
+
+// Build a BSP tree over the model-space faces of the mesh. Faces that straddle a splitting plane are
+// split in place, so the mesh gains vertices, tex coords and faces, but its face array still
+// describes the same surface. If the tree would be deeper than BSP_MAX_DEPTH, as for a nearly convex
+// mesh whose planes split off few faces each, it is left empty and the faces must be depth sorted.
+void bsp_build(bsp_tree_t* tree, struct mesh_t* mesh);
+
+// Returns true if the tree has been built.
+bool bsp_is_built(const bsp_tree_t* tree);
+
+// Writes the index of every face in the tree to order, which must have space for them all, from the
+// face farthest from the model-space eye position to the nearest. Returns the number of faces
+// written.
+int bsp_back_to_front(const bsp_tree_t* tree, vec3_t eye, int* order);
+
+// Free the memory associated with the tree, after which it is empty.
+void bsp_free(bsp_tree_t* tree);
+
+#endif
@@ -0,0 +1,167 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "array.h"
+#include "bvh.h"
+#include "mesh.h"
+#include "must.h"
+#include "sort.h"
+
+// Maximum number of clusters in a leaf. Clusters are already a coarse unit of work, so leaves stay
+// small to keep their boxes tight.
+#define BVH_LEAF_CLUSTERS 4
+
+typedef struct bvh_builder_t {
+	bvh_t* tree;
+	const mesh_t* mesh;
+	vec3_t* mins; // bounds of each cluster, indexed like the mesh's clusters
+	vec3_t* maxes;
+	depth_key_t* keys;
+	depth_key_t* scratch;
+} bvh_builder_t;
+
+static vec3_t vec3_min(vec3_t a, vec3_t b) {
+	return (vec3_t){ fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z) };
+}
+
+static vec3_t vec3_max(vec3_t a, vec3_t b) {
+	return (vec3_t){ fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z) };
+}
+
+static float vec3_component(vec3_t v, int axis) {
+	return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// build_node bounds the n clusters at the given indices, splitting them at the median of their
+// centers along the longest axis of the box, and returns the index of the new node.
+static int build_node(bvh_builder_t* b, int* clusters, int n) {
+	bvh_node_t node = {
+		.min = { INFINITY, INFINITY, INFINITY },
+		.max = { -INFINITY, -INFINITY, -INFINITY },
+		.left = -1,
+		.right = -1,
+		.first_cluster = 0,
+		.n_clusters = 0,
+	};
+	for (int i = 0; i < n; i++) {
+		node.min = vec3_min(node.min, b->mins[clusters[i]]);
+		node.max = vec3_max(node.max, b->maxes[clusters[i]]);
+	}
+
+	if (n <= BVH_LEAF_CLUSTERS) {
+		node.first_cluster = array_len(b->tree->clusters);
+		node.n_clusters = n;
+		for (int i = 0; i < n; i++) {
+			array_push(b->tree->clusters, clusters[i]);
+		}
+		array_push(b->tree->nodes, node);
+		return array_len(b->tree->nodes) - 1;
+	}
+
+	vec3_t size = vec3_sub(&node.max, &node.min);
+	int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+	for (int i = 0; i < n; i++) {
+		const cluster_t* c = &b->mesh->clusters[clusters[i]];
+		b->keys[i] = new_depth_key(vec3_component(c->center, axis), clusters[i]);
+	}
+	const depth_key_t* sorted = radix_sort_depth_keys(b->keys, b->scratch, n);
+	for (int i = 0; i < n; i++) {
+		clusters[i] = sorted[i].index;
+	}
+
+	// Children are built after the node is placed, so the node is referred to by index only.
+	array_push(b->tree->nodes, node);
+	int index = array_len(b->tree->nodes) - 1;
+	int left = build_node(b, clusters, n / 2);
+	int right = build_node(b, clusters + n / 2, n - n / 2);
+	b->tree->nodes[index].left = left;
+	b->tree->nodes[index].right = right;
+	return index;
+}
+
+void bvh_build(bvh_t* tree, mesh_t* mesh) {
+	bvh_free(tree);
+
+	int n_clusters = array_len(mesh->clusters);
+	if (n_clusters == 0) {
+		return;
+	}
+
+	bvh_builder_t b = {
+		.tree = tree,
+		.mesh = mesh,
+		.mins = must_malloc(sizeof(vec3_t) * n_clusters),
+		.maxes = must_malloc(sizeof(vec3_t) * n_clusters),
+		.keys = must_malloc(sizeof(depth_key_t) * n_clusters),
+		.scratch = must_malloc(sizeof(depth_key_t) * n_clusters),
+	};
+	int* clusters = must_malloc(sizeof(int) * n_clusters);
+	for (int i = 0; i < n_clusters; i++) {
+		const cluster_t* c = &mesh->clusters[i];
+		b.mins[i] = (vec3_t){ INFINITY, INFINITY, INFINITY };
+		b.maxes[i] = (vec3_t){ -INFINITY, -INFINITY, -INFINITY };
+		for (int j = 0; j < c->n_vertices; j++) {
+			b.mins[i] = vec3_min(b.mins[i], mesh->vertices[c->first_vertex + j]);
+			b.maxes[i] = vec3_max(b.maxes[i], mesh->vertices[c->first_vertex + j]);
+		}
+		clusters[i] = i;
+	}
+	tree->root = build_node(&b, clusters, n_clusters);
+
+	free(clusters);
+	free(b.scratch);
+	free(b.keys);
+	free(b.maxes);
+	free(b.mins);
+}
+
+// Writes every cluster below the node to visible from index n_visible, returning the new number of
+// visible clusters. If inside is set, the node is known to lie entirely inside the frustum, so
+// neither it nor its descendants are tested.
+static int cull_node(
+	const bvh_t* tree,
+	const mesh_t* mesh,
+	const frustum_t* frustum,
+	int node_index,
+	bool inside,
+	int* visible,
+	int n_visible
+) {
+	const bvh_node_t* node = &tree->nodes[node_index];
+	if (!inside) {
+		frustum_overlap_t overlap = frustum_classify_box(frustum, node->min, node->max);
+		if (overlap == FRUSTUM_OUTSIDE) {
+			return n_visible;
+		}
+		inside = overlap == FRUSTUM_INSIDE;
+	}
+
+	if (node->left >= 0) {
+		n_visible = cull_node(tree, mesh, frustum, node->left, inside, visible, n_visible);
+		return cull_node(tree, mesh, frustum, node->right, inside, visible, n_visible);
+	}
+
+	for (int i = 0; i < node->n_clusters; i++) {
+		int cluster_index = tree->clusters[node->first_cluster + i];
+		const cluster_t* c = &mesh->clusters[cluster_index];
+		if (inside || !frustum_excludes_sphere(frustum, c->center, c->radius)) {
+			visible[n_visible++] = cluster_index;
+		}
+	}
+	return n_visible;
+}
+
+int bvh_cull(const bvh_t* tree, const mesh_t* mesh, const frustum_t* frustum, int* visible) {
+	if (tree->root < 0) {
+		return 0;
+	}
+	return cull_node(tree, mesh, frustum, tree->root, false, visible, 0);
+}
+
+void bvh_free(bvh_t* tree) {
+	array_free(tree->nodes);
+	array_free(tree->clusters);
+	tree->nodes = NULL;
+	tree->clusters = NULL;
+	tree->root = -1;
+}
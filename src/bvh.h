@@ -0,0 +1,50 @@
+// bvh.h provides a bounding volume hierarchy over the clusters of a mesh, which finds the clusters
+// inside the view frustum at a cost that scales with the number visible rather than the number
+// loaded.
+#ifndef BVH_H
+#define BVH_H
+
+#include "frustum.h"
+#include "vector.h"
+
+struct mesh_t;
+
+/*
+Structs
+*/
+
+// bvh_node_t bounds a group of clusters with an axis-aligned box in model space. Interior nodes split
+// their clusters between two children, while leaves list them directly.
+typedef struct bvh_node_t {
+	vec3_t min;
+	vec3_t max;
+	int left; // index of the left child in the tree's nodes, or -1 for a leaf
+	int right; // index of the right child in the tree's nodes, or -1 for a leaf
+	int first_cluster; // index of the node's first cluster in the tree's clusters
+	int n_clusters;
+} bvh_node_t;
+
+// bvh_t stores its nodes and the mesh cluster indices they reference in flat arrays.
+typedef struct bvh_t {
+	bvh_node_t* nodes; // dynamic array
+	int* clusters; // dynamic array of mesh cluster indices, grouped by leaf
+	int root; // index of the root node, or -1 if the tree is empty
+} bvh_t;
+
+/*
+Functions
+*/
+
+// Build a BVH over the clusters of the mesh. Must be called once the mesh's clusters have been built
+// and while its vertex array is still populated.
+void bvh_build(bvh_t* tree, struct mesh_t* mesh);
+
+// Writes the index of every cluster of the mesh that is not entirely outside the frustum, given in
+// model space, to visible, which must have space for every cluster. Returns the number of clusters
+// written.
+int bvh_cull(const bvh_t* tree, const struct mesh_t* mesh, const frustum_t* frustum, int* visible);
+
+// Free the memory associated with the tree, after which it is empty.
+void bvh_free(bvh_t* tree);
+
+#endif
@@ -0,0 +1,910 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "file.h"
+#include "must.h"
+
+// Changed whenever the layout of the file changes, invalidating existing caches.
+#define MESH_CACHE_VERSION 4
+
+// Alignment in bytes of the data of every section, which suits the position streams.
+#define MESH_CACHE_ALIGN STREAM_ALIGN
+
+// Appended to the path of an .obj file to name its cache.
+#define MESH_CACHE_SUFFIX ".meshcache"
+
+// Appended to the path of a cache while it is written, so that an interrupted write never leaves a
+// partial cache in its place.
+#define MESH_CACHE_TEMP_SUFFIX ".tmp"
+
+// Appended to the path of an .obj file to name its chunked cache.
+#define CHUNK_CACHE_SUFFIX ".chunkcache"
+
+static const char MESH_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+static const char CHUNK_CACHE_MAGIC[4] = { 'M', 'S', 'H', 'K' };
+
+// mesh_cache_section_t identifies the arrays of a mesh that are stored as sections of the cache.
+typedef enum mesh_cache_section_t {
+	SECTION_FACES,
+	SECTION_NORMALS,
+	SECTION_TEX_COORDS,
+	SECTION_QUANTIZED_TEX_COORDS,
+	SECTION_CLUSTERS,
+	SECTION_FACE_CLUSTERS,
+	SECTION_BVH_NODES,
+	SECTION_BVH_CLUSTERS,
+	SECTION_BSP_NODES,
+	SECTION_BSP_FACES,
+	SECTION_POSITIONS_X,
+	SECTION_POSITIONS_Y,
+	SECTION_POSITIONS_Z,
+	SECTION_QUANTIZED_X,
+	SECTION_QUANTIZED_Y,
+	SECTION_QUANTIZED_Z,
+	N_SECTIONS,
+} mesh_cache_section_t;
+
+// Size in bytes of an element of each section.
+static const uint32_t SECTION_ELEMENT_SIZES[N_SECTIONS] = {
+	[SECTION_FACES] = sizeof(mesh_face_t),
+	[SECTION_NORMALS] = sizeof(vec3_t),
+	[SECTION_TEX_COORDS] = sizeof(tex2_t),
+	[SECTION_QUANTIZED_TEX_COORDS] = sizeof(quantized_tex2_t),
+	[SECTION_CLUSTERS] = sizeof(cluster_t),
+	[SECTION_FACE_CLUSTERS] = sizeof(int),
+	[SECTION_BVH_NODES] = sizeof(bvh_node_t),
+	[SECTION_BVH_CLUSTERS] = sizeof(int),
+	[SECTION_BSP_NODES] = sizeof(bsp_node_t),
+	[SECTION_BSP_FACES] = sizeof(int),
+	[SECTION_POSITIONS_X] = sizeof(float),
+	[SECTION_POSITIONS_Y] = sizeof(float),
+	[SECTION_POSITIONS_Z] = sizeof(float),
+	[SECTION_QUANTIZED_X] = sizeof(uint16_t),
+	[SECTION_QUANTIZED_Y] = sizeof(uint16_t),
+	[SECTION_QUANTIZED_Z] = sizeof(uint16_t),
+};
+
+// cache_section_ref_t locates a section of the file. The data of every section is preceded by an
+// array header, so that it can be used in place as a dynamic array.
+typedef struct cache_section_ref_t {
+	uint64_t offset; // offset of the section's data, a multiple of MESH_CACHE_ALIGN
+	int32_t len; // number of elements
+	int32_t reserved;
+} cache_section_ref_t;
+
+// cache_level_t describes one level of detail of the cached mesh.
+typedef struct cache_level_t {
+	cache_section_ref_t sections[N_SECTIONS];
+	int32_t n_positions;
+	int32_t bvh_root;
+	int32_t bsp_root;
+	int32_t is_convex;
+	int32_t is_quantized;
+	int32_t reserved;
+	mesh_quantization_t quantization;
+} cache_level_t;
+
+// cache_header_t begins the file, and is followed by a cache_level_t for each level of detail, most
+// detailed first, and then by the sections of every level.
+typedef struct cache_header_t {
+	char magic[4];
+	uint32_t version;
+	uint64_t obj_size;
+	int64_t obj_mtime_sec;
+	int64_t obj_mtime_nsec;
+	uint32_t element_sizes[N_SECTIONS]; // detects builds whose structs are laid out differently
+	uint32_t build_lods;
+	uint32_t quantize;
+	uint32_t n_levels;
+	uint32_t reserved;
+} cache_header_t;
+
+// chunk_cache_header_t begins a chunked cache, and is followed by a cache_chunk_t for each chunk and
+// then by the levels of every chunk. Each level is a cache_level_t followed by its sections, whose
+// offsets count from the start of the level, so that it can be read on its own.
+typedef struct chunk_cache_header_t {
+	cache_header_t mesh; // n_levels is unused
+	uint32_t n_chunks;
+	uint32_t reserved;
+} chunk_cache_header_t;
+
+// Returns the path of the cache with the given cache suffix for the .obj file at obj_path, with the
+// suffix appended, which must be freed.
+static char* cache_path(const char* obj_path, const char* cache_suffix, const char* suffix) {
+	size_t size = strlen(obj_path) + strlen(cache_suffix) + strlen(suffix) + 1;
+	char* path = must_malloc(size);
+	snprintf(path, size, "%s%s%s", obj_path, cache_suffix, suffix);
+	return path;
+}
+
+// Returns the header a cache of the .obj file at obj_path should have, or false if the file can't be
+// found.
+static bool expected_header(const char* obj_path, bool build_lods, bool quantize, cache_header_t* dst) {
+	struct stat st;
+	if (stat(obj_path, &st) != 0) {
+		return false;
+	}
+
+	*dst = (cache_header_t){
+		.version = MESH_CACHE_VERSION,
+		.obj_size = st.st_size,
+		.obj_mtime_sec = st.st_mtim.tv_sec,
+		.obj_mtime_nsec = st.st_mtim.tv_nsec,
+		.build_lods = build_lods,
+		.quantize = quantize,
+	};
+	memcpy(dst->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	memcpy(dst->element_sizes, SECTION_ELEMENT_SIZES, sizeof(SECTION_ELEMENT_SIZES));
+	return true;
+}
+
+static uint64_t align_up(uint64_t offset) {
+	return (offset + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+}
+
+// Returns the data and length of the given section of the mesh.
+static const void* mesh_section(const mesh_t* mesh, mesh_cache_section_t section, int* len) {
+	// Streams are stored with their padding, which the vertex stage reads.
+	int n_streamed = mesh->positions.len > 0 ? stream_padded_len(mesh->positions.len) : 0;
+	int n_float_streamed = mesh->positions.x != NULL ? n_streamed : 0;
+	int n_quantized_streamed = mesh->positions.qx != NULL ? n_streamed : 0;
+	switch (section) {
+	case SECTION_FACES:
+		*len = array_len(mesh->faces);
+		return mesh->faces;
+	case SECTION_NORMALS:
+		*len = array_len(mesh->normals);
+		return mesh->normals;
+	case SECTION_TEX_COORDS:
+		*len = array_len(mesh->tex_coords);
+		return mesh->tex_coords;
+	case SECTION_QUANTIZED_TEX_COORDS:
+		*len = array_len(mesh->quantized_tex_coords);
+		return mesh->quantized_tex_coords;
+	case SECTION_CLUSTERS:
+		*len = array_len(mesh->clusters);
+		return mesh->clusters;
+	case SECTION_FACE_CLUSTERS:
+		*len = array_len(mesh->face_clusters);
+		return mesh->face_clusters;
+	case SECTION_BVH_NODES:
+		*len = array_len(mesh->bvh.nodes);
+		return mesh->bvh.nodes;
+	case SECTION_BVH_CLUSTERS:
+		*len = array_len(mesh->bvh.clusters);
+		return mesh->bvh.clusters;
+	case SECTION_BSP_NODES:
+		*len = array_len(mesh->bsp.nodes);
+		return mesh->bsp.nodes;
+	case SECTION_BSP_FACES:
+		*len = array_len(mesh->bsp.faces);
+		return mesh->bsp.faces;
+	case SECTION_POSITIONS_X:
+		*len = n_float_streamed;
+		return mesh->positions.x;
+	case SECTION_POSITIONS_Y:
+		*len = n_float_streamed;
+		return mesh->positions.y;
+	case SECTION_POSITIONS_Z:
+		*len = n_float_streamed;
+		return mesh->positions.z;
+	case SECTION_QUANTIZED_X:
+		*len = n_quantized_streamed;
+		return mesh->positions.qx;
+	case SECTION_QUANTIZED_Y:
+		*len = n_quantized_streamed;
+		return mesh->positions.qy;
+	case SECTION_QUANTIZED_Z:
+		*len = n_quantized_streamed;
+		return mesh->positions.qz;
+	case N_SECTIONS:
+		break;
+	}
+	*len = 0;
+	return NULL;
+}
+
+// Point the mesh's array for the given section at data.
+static void set_mesh_section(mesh_t* mesh, mesh_cache_section_t section, void* data) {
+	switch (section) {
+	case SECTION_FACES:
+		mesh->faces = data;
+		break;
+	case SECTION_NORMALS:
+		mesh->normals = data;
+		break;
+	case SECTION_TEX_COORDS:
+		mesh->tex_coords = data;
+		break;
+	case SECTION_QUANTIZED_TEX_COORDS:
+		mesh->quantized_tex_coords = data;
+		break;
+	case SECTION_CLUSTERS:
+		mesh->clusters = data;
+		break;
+	case SECTION_FACE_CLUSTERS:
+		mesh->face_clusters = data;
+		break;
+	case SECTION_BVH_NODES:
+		mesh->bvh.nodes = data;
+		break;
+	case SECTION_BVH_CLUSTERS:
+		mesh->bvh.clusters = data;
+		break;
+	case SECTION_BSP_NODES:
+		mesh->bsp.nodes = data;
+		break;
+	case SECTION_BSP_FACES:
+		mesh->bsp.faces = data;
+		break;
+	case SECTION_POSITIONS_X:
+		mesh->positions.x = data;
+		break;
+	case SECTION_POSITIONS_Y:
+		mesh->positions.y = data;
+		break;
+	case SECTION_POSITIONS_Z:
+		mesh->positions.z = data;
+		break;
+	case SECTION_QUANTIZED_X:
+		mesh->positions.qx = data;
+		break;
+	case SECTION_QUANTIZED_Y:
+		mesh->positions.qy = data;
+		break;
+	case SECTION_QUANTIZED_Z:
+		mesh->positions.qz = data;
+		break;
+	case N_SECTIONS:
+		break;
+	}
+}
+
+// Returns the number of levels of detail in the mesh's chain, including the mesh itself.
+static int count_levels(const mesh_t* mesh) {
+	int n = 0;
+	for (; mesh != NULL; mesh = mesh->coarser) {
+		n++;
+	}
+	return n;
+}
+
+// BVHs are built by splitting their clusters in half, so no valid tree is deeper than this.
+#define MESH_CACHE_MAX_BVH_DEPTH 64
+
+// Returns true if the array header stored before the section's data in the file matches the length
+// recorded for it in the level table, since the array functions read the length from there.
+static bool section_header_valid(const void* data, int len) {
+	if (data == NULL) {
+		return len == 0;
+	}
+	char expected[ARRAY_HEADER_SIZE];
+	array_write_header(expected, len);
+	return memcmp((const char*)data - ARRAY_HEADER_SIZE, expected, ARRAY_HEADER_SIZE) == 0;
+}
+
+// Returns true if the lengths of the level's sections agree with each other and with its number of
+// positions.
+static bool section_lengths_valid(const cache_level_t* level) {
+	const cache_section_ref_t* s = level->sections;
+	int n_positions = level->n_positions;
+	if (n_positions < 0 || (level->is_convex != 0 && level->is_convex != 1)) {
+		return false;
+	}
+	int n_streamed = n_positions > 0 ? stream_padded_len(n_positions) : 0;
+	int n_float_streamed = 0;
+	int n_quantized_streamed = 0;
+	int n_tex_coords = 0;
+	int n_quantized_tex_coords = 0;
+	if (level->is_quantized == 1) {
+		n_quantized_streamed = n_streamed;
+		n_quantized_tex_coords = n_positions;
+	} else if (level->is_quantized == 0) {
+		n_float_streamed = n_streamed;
+		n_tex_coords = n_positions;
+	} else {
+		return false;
+	}
+
+	int n_faces = s[SECTION_FACES].len;
+	return (
+		s[SECTION_NORMALS].len == n_faces &&
+		s[SECTION_FACE_CLUSTERS].len == n_faces &&
+		s[SECTION_TEX_COORDS].len == n_tex_coords &&
+		s[SECTION_QUANTIZED_TEX_COORDS].len == n_quantized_tex_coords &&
+		s[SECTION_POSITIONS_X].len == n_float_streamed &&
+		s[SECTION_POSITIONS_Y].len == n_float_streamed &&
+		s[SECTION_POSITIONS_Z].len == n_float_streamed &&
+		s[SECTION_QUANTIZED_X].len == n_quantized_streamed &&
+		s[SECTION_QUANTIZED_Y].len == n_quantized_streamed &&
+		s[SECTION_QUANTIZED_Z].len == n_quantized_streamed
+	);
+}
+
+// Returns true if the mesh's clusters cover its faces in order, each with its own run of the mesh's
+// vertices, and every face belongs to its recorded cluster and refers only to that cluster's
+// vertices. The runs are bounded by the number of vertices rather than the padded length of the
+// position streams, since the tex coords aren't padded.
+static bool clusters_valid(const mesh_t* mesh) {
+	int n_faces = array_len(mesh->faces);
+	int n_clusters = array_len(mesh->clusters);
+	int n_vertices = mesh->positions.len;
+	int end_face = 0;
+	for (int i = 0; i < n_clusters; i++) {
+		const cluster_t* c = &mesh->clusters[i];
+		if (
+			c->first_face != end_face ||
+			c->n_faces < 0 ||
+			c->n_faces > n_faces - end_face ||
+			c->first_vertex < 0 ||
+			c->first_vertex % STREAM_LANES != 0 ||
+			c->n_vertices < 0 ||
+			c->first_vertex > n_vertices ||
+			c->n_vertices > n_vertices - c->first_vertex
+		) {
+			return false;
+		}
+		end_face += c->n_faces;
+
+		uint32_t first_vertex = c->first_vertex;
+		uint32_t end_vertex = first_vertex + c->n_vertices;
+		for (int f = c->first_face; f < end_face; f++) {
+			const mesh_face_t* mf = &mesh->faces[f];
+			if (
+				mesh->face_clusters[f] != i ||
+				mf->a < first_vertex || mf->a >= end_vertex ||
+				mf->b < first_vertex || mf->b >= end_vertex ||
+				mf->c < first_vertex || mf->c >= end_vertex
+			) {
+				return false;
+			}
+		}
+	}
+	return end_face == n_faces;
+}
+
+// Returns true if the BVH's nodes form a tree below its root, stored in the order they were built,
+// whose leaves list every one of the mesh's n_clusters clusters at most once.
+static bool bvh_valid(const bvh_t* tree, int n_clusters) {
+	int n_nodes = array_len(tree->nodes);
+	int n_tree_clusters = array_len(tree->clusters);
+	if (n_nodes == 0) {
+		return tree->root == -1 && n_tree_clusters == 0;
+	}
+	// Children are built after their parents, and leaves take their clusters in the same order.
+	if (tree->root != 0 || n_tree_clusters > n_clusters) {
+		return false;
+	}
+
+	// The depth of each node, which is 0 until its parent refers to it.
+	int* depths = must_calloc(n_nodes, sizeof(int));
+	bool* is_listed = must_calloc(n_clusters > 0 ? n_clusters : 1, sizeof(bool));
+	depths[0] = 1;
+	int end_cluster = 0;
+	bool is_valid = true;
+	for (int i = 0; i < n_nodes && is_valid; i++) {
+		const bvh_node_t* node = &tree->nodes[i];
+		is_valid = depths[i] > 0;
+		if (!is_valid) {
+			break;
+		}
+
+		if (node->left < 0) {
+			is_valid = (
+				node->left == -1 &&
+				node->right == -1 &&
+				node->first_cluster == end_cluster &&
+				node->n_clusters >= 0 &&
+				node->n_clusters <= n_tree_clusters - end_cluster
+			);
+			for (int j = 0; j < node->n_clusters && is_valid; j++) {
+				int cluster_index = tree->clusters[end_cluster + j];
+				is_valid = cluster_index >= 0 && cluster_index < n_clusters && !is_listed[cluster_index];
+				if (is_valid) {
+					is_listed[cluster_index] = true;
+				}
+			}
+			end_cluster += node->n_clusters;
+			continue;
+		}
+
+		int children[2] = { node->left, node->right };
+		for (int j = 0; j < 2 && is_valid; j++) {
+			int child = children[j];
+			is_valid = (
+				child > i &&
+				child < n_nodes &&
+				depths[child] == 0 &&
+				depths[i] < MESH_CACHE_MAX_BVH_DEPTH
+			);
+			if (is_valid) {
+				depths[child] = depths[i] + 1;
+			}
+		}
+	}
+	free(is_listed);
+	free(depths);
+	return is_valid && end_cluster == n_tree_clusters;
+}
+
+// Returns true if the BSP tree's nodes form a tree below its root no deeper than BSP_MAX_DEPTH,
+// stored in the order they were built, whose nodes list faces of a mesh with n_faces faces.
+static bool bsp_valid(const bsp_tree_t* tree, int n_faces) {
+	int n_nodes = array_len(tree->nodes);
+	int n_tree_faces = array_len(tree->faces);
+	if (n_nodes == 0) {
+		return tree->root == -1 && n_tree_faces == 0;
+	}
+	// Nodes are stored in preorder, each taking its faces after those of the nodes before it.
+	if (tree->root != 0) {
+		return false;
+	}
+	for (int i = 0; i < n_tree_faces; i++) {
+		if (tree->faces[i] < 0 || tree->faces[i] >= n_faces) {
+			return false;
+		}
+	}
+
+	// The depth of each node, which is 0 until its parent refers to it.
+	int* depths = must_calloc(n_nodes, sizeof(int));
+	depths[0] = 1;
+	int end_face = 0;
+	bool is_valid = true;
+	for (int i = 0; i < n_nodes && is_valid; i++) {
+		const bsp_node_t* node = &tree->nodes[i];
+		is_valid = (
+			depths[i] > 0 &&
+			node->first_face == end_face &&
+			node->n_faces >= 0 &&
+			node->n_faces <= n_tree_faces - end_face
+		);
+		end_face += is_valid ? node->n_faces : 0;
+
+		int children[2] = { node->front, node->back };
+		for (int j = 0; j < 2 && is_valid; j++) {
+			int child = children[j];
+			if (child == -1) {
+				continue;
+			}
+			is_valid = (
+				child > i &&
+				child < n_nodes &&
+				depths[child] == 0 &&
+				depths[i] < BSP_MAX_DEPTH
+			);
+			if (is_valid) {
+				depths[child] = depths[i] + 1;
+			}
+		}
+	}
+	free(depths);
+	return is_valid && end_face == n_tree_faces;
+}
+
+// load_level points the level's arrays at their sections in the mapped file, returning false if any
+// section lies outside the file, or if the lengths of the sections or the indices they hold are
+// inconsistent, so that a corrupt cache is rejected rather than read out of bounds while rendering.
+static bool load_level(mesh_t* dst, const cache_level_t* level, const mapped_file_t* file) {
+	*dst = new_mesh();
+	dst->is_cached = true;
+	if (!section_lengths_valid(level)) {
+		return false;
+	}
+	for (int s = 0; s < N_SECTIONS; s++) {
+		const cache_section_ref_t* ref = &level->sections[s];
+		if (ref->len == 0) {
+			continue;
+		}
+		uint64_t size = (uint64_t)ref->len * SECTION_ELEMENT_SIZES[s];
+		if (
+			ref->len < 0 ||
+			ref->offset % MESH_CACHE_ALIGN != 0 ||
+			ref->offset < ARRAY_HEADER_SIZE ||
+			ref->offset > file->size ||
+			size > file->size - ref->offset
+		) {
+			return false;
+		}
+		// The mapping is read-only, and cached meshes are never modified once loaded.
+		void* data = (void*)(file->data + ref->offset);
+		if (!section_header_valid(data, ref->len)) {
+			return false;
+		}
+		set_mesh_section(dst, s, data);
+	}
+
+	dst->positions.len = level->n_positions;
+	dst->bvh.root = level->bvh_root;
+	dst->bsp.root = level->bsp_root;
+	dst->is_convex = level->is_convex;
+	dst->is_quantized = level->is_quantized;
+	dst->quantization = level->quantization;
+	int n_faces = array_len(dst->faces);
+	return (
+		clusters_valid(dst) &&
+		bvh_valid(&dst->bvh, array_len(dst->clusters)) &&
+		bsp_valid(&dst->bsp, n_faces)
+	);
+}
+
+bool mesh_cache_load(mesh_t* dst, const char* obj_path, bool build_lods, bool quantize) {
+	cache_header_t expected;
+	if (!expected_header(obj_path, build_lods, quantize, &expected)) {
+		return false;
+	}
+
+	char* path = cache_path(obj_path, MESH_CACHE_SUFFIX, "");
+	mapped_file_t file;
+	bool is_mapped = map_file(path, &file);
+	free(path);
+	if (!is_mapped) {
+		return false;
+	}
+
+	cache_header_t header;
+	if (file.size < sizeof(header)) {
+		unmap_file(&file);
+		return false;
+	}
+	memcpy(&header, file.data, sizeof(header));
+	uint32_t n_levels = header.n_levels;
+	header.n_levels = 0;
+	if (
+		memcmp(&header, &expected, sizeof(header)) != 0 ||
+		n_levels == 0 ||
+		n_levels > (file.size - sizeof(header)) / sizeof(cache_level_t)
+	) {
+		unmap_file(&file);
+		return false;
+	}
+
+	const cache_level_t* levels = (const cache_level_t*)(file.data + sizeof(header));
+	mesh_t* mesh = dst;
+	for (uint32_t i = 0; i < n_levels; i++) {
+		if (!load_level(mesh, &levels[i], &file)) {
+			mesh_free(dst);
+			unmap_file(&file);
+			*dst = new_mesh();
+			return false;
+		}
+		if (i + 1 < n_levels) {
+			mesh->coarser = must_malloc(sizeof(mesh_t));
+			*mesh->coarser = new_mesh();
+			mesh = mesh->coarser;
+		}
+	}
+	dst->cache = file;
+	return true;
+}
+
+// Write zeros to the file until offset bytes have been written.
+static void write_padding(FILE* f, uint64_t* written, uint64_t offset) {
+	static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+	while (*written < offset) {
+		uint64_t n = offset - *written < MESH_CACHE_ALIGN ? offset - *written : MESH_CACHE_ALIGN;
+		fwrite(zeros, 1, n, f);
+		*written += n;
+	}
+}
+
+// layout_level lays out the sections of the level one after another from offset, writing their
+// locations to dst along with the level's other fields. Returns the offset of the end of the last
+// section.
+static uint64_t layout_level(const mesh_t* level, uint64_t offset, cache_level_t* dst) {
+	*dst = (cache_level_t){
+		.n_positions = level->positions.len,
+		.bvh_root = level->bvh.root,
+		.bsp_root = level->bsp.root,
+		.is_convex = level->is_convex,
+		.is_quantized = level->is_quantized,
+		.quantization = level->quantization,
+	};
+	for (int s = 0; s < N_SECTIONS; s++) {
+		int len;
+		mesh_section(level, s, &len);
+		offset = align_up(offset + ARRAY_HEADER_SIZE);
+		dst->sections[s] = (cache_section_ref_t){ .offset = offset, .len = len };
+		offset += (uint64_t)len * SECTION_ELEMENT_SIZES[s];
+	}
+	return offset;
+}
+
+// write_sections writes the sections of the level as laid out by layout_level, each preceded by its
+// array header, given that written bytes have been written since the offset the layout counts from.
+static void write_sections(FILE* f, const mesh_t* level, const cache_level_t* layout, uint64_t* written) {
+	for (int s = 0; s < N_SECTIONS; s++) {
+		int len;
+		const void* data = mesh_section(level, s, &len);
+		char array_header[ARRAY_HEADER_SIZE];
+		array_write_header(array_header, len);
+		write_padding(f, written, layout->sections[s].offset - ARRAY_HEADER_SIZE);
+		fwrite(array_header, ARRAY_HEADER_SIZE, 1, f);
+		if (len > 0) {
+			fwrite(data, SECTION_ELEMENT_SIZES[s], len, f);
+		}
+		*written += ARRAY_HEADER_SIZE + (uint64_t)len * SECTION_ELEMENT_SIZES[s];
+	}
+}
+
+void mesh_cache_write(const mesh_t* mesh, const char* obj_path, bool build_lods, bool quantize) {
+	cache_header_t header;
+	if (!expected_header(obj_path, build_lods, quantize, &header)) {
+		return;
+	}
+	header.n_levels = count_levels(mesh);
+
+	// Lay out the sections of every level after the level table.
+	cache_level_t* levels = must_malloc(sizeof(cache_level_t) * header.n_levels);
+	uint64_t offset = sizeof(header) + sizeof(cache_level_t) * header.n_levels;
+	int i = 0;
+	for (const mesh_t* level = mesh; level != NULL; level = level->coarser, i++) {
+		offset = layout_level(level, offset, &levels[i]);
+	}
+
+	char* temp_path = cache_path(obj_path, MESH_CACHE_SUFFIX, MESH_CACHE_TEMP_SUFFIX);
+	char* path = cache_path(obj_path, MESH_CACHE_SUFFIX, "");
+	FILE* f = fopen(temp_path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "failed to open %s in mode wb\n", temp_path);
+		free(levels);
+		free(temp_path);
+		free(path);
+		return;
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(levels, sizeof(cache_level_t), header.n_levels, f);
+	uint64_t written = sizeof(header) + sizeof(cache_level_t) * header.n_levels;
+	i = 0;
+	for (const mesh_t* level = mesh; level != NULL; level = level->coarser, i++) {
+		write_sections(f, level, &levels[i], &written);
+	}
+
+	bool failed = ferror(f);
+	failed |= fclose(f) != 0;
+	if (failed || rename(temp_path, path) != 0) {
+		fprintf(stderr, "failed to write mesh cache %s\n", path);
+		remove(temp_path);
+	}
+	free(levels);
+	free(temp_path);
+	free(path);
+}
+
+// Returns the header a chunked cache of the .obj file at obj_path should have, or false if the file
+// can't be found. Chunks always have levels of detail, and are never quantized.
+static bool expected_chunk_header(const char* obj_path, chunk_cache_header_t* dst) {
+	*dst = (chunk_cache_header_t){ 0 };
+	if (!expected_header(obj_path, true, false, &dst->mesh)) {
+		return false;
+	}
+	memcpy(dst->mesh.magic, CHUNK_CACHE_MAGIC, sizeof(CHUNK_CACHE_MAGIC));
+	return true;
+}
+
+// Returns the offset of the end of the table of a chunked cache of n_chunks chunks.
+static uint64_t chunk_table_end(int n_chunks) {
+	return align_up(sizeof(chunk_cache_header_t) + sizeof(cache_chunk_t) * (uint64_t)n_chunks);
+}
+
+// Read size bytes at offset in the file into dst, returning false if they can't all be read.
+static bool read_at(int fd, void* dst, uint64_t size, uint64_t offset) {
+	while (size > 0) {
+		ssize_t n = pread(fd, dst, size, offset);
+		if (n <= 0) {
+			return false;
+		}
+		dst = (char*)dst + n;
+		size -= n;
+		offset += n;
+	}
+	return true;
+}
+
+// Returns true if the chunk's bounds are ordered and its levels lie between the end of the table and
+// the end of a file of file_size bytes, each large enough to describe itself.
+static bool chunk_valid(const cache_chunk_t* chunk, uint64_t table_end, uint64_t file_size) {
+	if (
+		chunk->n_levels < 1 ||
+		chunk->n_levels > CHUNK_CACHE_MAX_LEVELS ||
+		!(chunk->min.x <= chunk->max.x && chunk->min.y <= chunk->max.y && chunk->min.z <= chunk->max.z)
+	) {
+		return false;
+	}
+	for (int i = 0; i < chunk->n_levels; i++) {
+		const cache_chunk_level_t* level = &chunk->levels[i];
+		if (
+			level->offset < table_end ||
+			level->offset % MESH_CACHE_ALIGN != 0 ||
+			level->offset > file_size ||
+			level->size < sizeof(cache_level_t) ||
+			level->size % MESH_CACHE_ALIGN != 0 ||
+			level->size > file_size - level->offset ||
+			level->n_faces < 0
+		) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool chunk_cache_open(chunk_cache_t* dst, const char* obj_path) {
+	*dst = (chunk_cache_t){ .fd = -1 };
+	chunk_cache_header_t expected;
+	if (!expected_chunk_header(obj_path, &expected)) {
+		return false;
+	}
+
+	char* path = cache_path(obj_path, CHUNK_CACHE_SUFFIX, "");
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	chunk_cache_header_t header;
+	if (fstat(fd, &st) != 0 || !read_at(fd, &header, sizeof(header), 0)) {
+		close(fd);
+		return false;
+	}
+	uint32_t n_chunks = header.n_chunks;
+	header.n_chunks = 0;
+	uint64_t file_size = st.st_size;
+	if (
+		memcmp(&header, &expected, sizeof(header)) != 0 ||
+		n_chunks > (file_size - sizeof(header)) / sizeof(cache_chunk_t)
+	) {
+		close(fd);
+		return false;
+	}
+
+	cache_chunk_t* chunks = must_malloc(sizeof(cache_chunk_t) * (n_chunks > 0 ? n_chunks : 1));
+	bool is_valid = read_at(fd, chunks, sizeof(cache_chunk_t) * n_chunks, sizeof(header));
+	uint64_t table_end = chunk_table_end(n_chunks);
+	for (uint32_t i = 0; i < n_chunks && is_valid; i++) {
+		is_valid = chunk_valid(&chunks[i], table_end, file_size);
+	}
+	if (!is_valid) {
+		free(chunks);
+		close(fd);
+		return false;
+	}
+
+	*dst = (chunk_cache_t){ .chunks = chunks, .n_chunks = n_chunks, .fd = fd, .size = file_size };
+	return true;
+}
+
+bool chunk_cache_create(chunk_cache_t* dst, const char* obj_path, int n_chunks) {
+	*dst = (chunk_cache_t){ .fd = -1 };
+	char* temp_path = cache_path(obj_path, CHUNK_CACHE_SUFFIX, MESH_CACHE_TEMP_SUFFIX);
+	FILE* f = fopen(temp_path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "failed to open %s in mode wb\n", temp_path);
+		free(temp_path);
+		return false;
+	}
+	int fd = open(temp_path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "failed to open %s for reading\n", temp_path);
+		fclose(f);
+		remove(temp_path);
+		free(temp_path);
+		return false;
+	}
+
+	*dst = (chunk_cache_t){
+		.chunks = must_calloc(n_chunks > 0 ? n_chunks : 1, sizeof(cache_chunk_t)),
+		.n_chunks = n_chunks,
+		.fd = fd,
+		.file = f,
+		.temp_path = temp_path,
+	};
+	// The header and table are written once the cache is finished.
+	write_padding(f, &dst->size, chunk_table_end(n_chunks));
+	return true;
+}
+
+bool chunk_cache_write_chunk(chunk_cache_t* cache, int chunk, const mesh_t* mesh) {
+	int n_levels = count_levels(mesh);
+	cache_chunk_t* entry = &cache->chunks[chunk];
+	*entry = (cache_chunk_t){
+		.min = { INFINITY, INFINITY, INFINITY },
+		.max = { -INFINITY, -INFINITY, -INFINITY },
+		.n_levels = n_levels < CHUNK_CACHE_MAX_LEVELS ? n_levels : CHUNK_CACHE_MAX_LEVELS,
+	};
+	// Chunks are never quantized, so their float streams hold their positions.
+	const mesh_positions_t* p = &mesh->positions;
+	vec3_t min = entry->min;
+	vec3_t max = entry->max;
+	for (int i = 0; i < p->len; i++) {
+		vec3_t v = { p->x[i], p->y[i], p->z[i] };
+		min = (vec3_t){ fminf(min.x, v.x), fminf(min.y, v.y), fminf(min.z, v.z) };
+		max = (vec3_t){ fmaxf(max.x, v.x), fmaxf(max.y, v.y), fmaxf(max.z, v.z) };
+	}
+	entry->min = min;
+	entry->max = max;
+
+	const mesh_t* level = mesh;
+	for (int i = 0; i < entry->n_levels; i++, level = level->coarser) {
+		cache_level_t layout;
+		uint64_t size = align_up(layout_level(level, sizeof(layout), &layout));
+		fwrite(&layout, sizeof(layout), 1, cache->file);
+		uint64_t written = sizeof(layout);
+		write_sections(cache->file, level, &layout, &written);
+		write_padding(cache->file, &written, size);
+		entry->levels[i] = (cache_chunk_level_t){
+			.offset = cache->size,
+			.size = size,
+			.n_faces = array_len(level->faces),
+		};
+		cache->size += size;
+	}
+	// Flushing lets the chunk's levels be read back through the cache's descriptor.
+	return fflush(cache->file) == 0 && !ferror(cache->file);
+}
+
+void chunk_cache_finish(chunk_cache_t* cache, const char* obj_path) {
+	chunk_cache_header_t header;
+	bool failed = !expected_chunk_header(obj_path, &header);
+	header.n_chunks = cache->n_chunks;
+	failed |= fseeko(cache->file, 0, SEEK_SET) != 0;
+	fwrite(&header, sizeof(header), 1, cache->file);
+	fwrite(cache->chunks, sizeof(cache_chunk_t), cache->n_chunks, cache->file);
+	failed |= ferror(cache->file);
+	failed |= fclose(cache->file) != 0;
+	cache->file = NULL;
+
+	// The cache's descriptor remains open to the file, wherever it ends up.
+	char* path = cache_path(obj_path, CHUNK_CACHE_SUFFIX, "");
+	if (failed || rename(cache->temp_path, path) != 0) {
+		fprintf(stderr, "failed to write chunk cache %s\n", path);
+		remove(cache->temp_path);
+	}
+	free(cache->temp_path);
+	cache->temp_path = NULL;
+	free(path);
+}
+
+void* chunk_cache_load_level(const chunk_cache_t* cache, int chunk, int level, mesh_t* dst) {
+	*dst = new_mesh();
+	const cache_chunk_level_t* ref = &cache->chunks[chunk].levels[level];
+	char* data = must_aligned_alloc(MESH_CACHE_ALIGN, ref->size);
+	cache_level_t layout;
+	mapped_file_t view = { .data = data, .size = ref->size };
+	bool is_loaded = read_at(cache->fd, data, ref->size, ref->offset);
+	if (is_loaded) {
+		memcpy(&layout, data, sizeof(layout));
+		is_loaded = load_level(dst, &layout, &view);
+	}
+	if (!is_loaded) {
+		mesh_free(dst);
+		*dst = new_mesh();
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+void chunk_cache_close(chunk_cache_t* cache) {
+	if (cache->file != NULL) {
+		fclose(cache->file);
+		remove(cache->temp_path);
+	}
+	free(cache->temp_path);
+	if (cache->fd >= 0) {
+		close(cache->fd);
+	}
+	free(cache->chunks);
+	*cache = (chunk_cache_t){ .fd = -1 };
+}
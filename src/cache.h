@@ -0,0 +1,99 @@
+// cache.h provides a binary file format for prepared meshes. A mesh loaded from an .obj file is
+// written to a cache next to it, which later runs map into memory and use in place, skipping both
+// parsing and preparation. Meshes too large to load whole are instead cached in chunks, whose levels
+// of detail are each read into memory on their own.
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mesh.h"
+
+/*
+Constants
+*/
+
+// Maximum number of levels of detail of a chunk in a chunked cache.
+#define CHUNK_CACHE_MAX_LEVELS 16
+
+/*
+Structs
+*/
+
+// cache_chunk_level_t locates a level of detail of a chunk in a chunked cache.
+typedef struct cache_chunk_level_t {
+	uint64_t offset;
+	uint64_t size; // size in bytes, which is also the memory the level takes once loaded
+	int32_t n_faces;
+	int32_t reserved;
+} cache_chunk_level_t;
+
+// cache_chunk_t describes a chunk in a chunked cache.
+typedef struct cache_chunk_t {
+	vec3_t min; // bounds of the chunk's positions in model space
+	vec3_t max;
+	int32_t n_levels;
+	int32_t reserved;
+	cache_chunk_level_t levels[CHUNK_CACHE_MAX_LEVELS]; // most detailed first
+} cache_chunk_t;
+
+// chunk_cache_t is an open chunked cache. A cache that is being built may be read from as soon as
+// each chunk is written.
+typedef struct chunk_cache_t {
+	cache_chunk_t* chunks;
+	int n_chunks;
+	int fd; // descriptor the levels are read from
+	FILE* file; // the temporary file the cache is written to while it is built, or NULL
+	char* temp_path; // path of the temporary file, or NULL
+	uint64_t size; // bytes written to the file
+} chunk_cache_t;
+
+/*
+Functions
+*/
+
+// Load the mesh cached for the .obj file at obj_path into dst, along with its levels of detail. The
+// cache is only used if it was written for the file's current size and modification time and for the
+// same build_lods and quantize, and by a build with the same layout. The mesh's arrays view the
+// mapped cache, so loading costs no more than reading the pages that are used, apart from a pass
+// that checks the lengths of the sections and the indices they hold. Returns false if there is no
+// usable cache, or if it is corrupt.
+bool mesh_cache_load(mesh_t* dst, const char* obj_path, bool build_lods, bool quantize);
+
+// Write the prepared mesh and its levels of detail to the cache for the .obj file at obj_path.
+// Failure to write the cache is reported but otherwise harmless, since the mesh will be loaded from
+// the .obj file again.
+void mesh_cache_write(const mesh_t* mesh, const char* obj_path, bool build_lods, bool quantize);
+
+// Open the chunked cache for the .obj file at obj_path, which is only used if it was written for the
+// file's current size and modification time by a build with the same layout. Only the table of
+// chunks is read. Returns false if there is no usable cache, or if its table is corrupt.
+bool chunk_cache_open(chunk_cache_t* dst, const char* obj_path);
+
+// Begin building a chunked cache of n_chunks chunks for the .obj file at obj_path, which is written
+// to a temporary file until it is finished. Returns false if the file can't be opened.
+bool chunk_cache_create(chunk_cache_t* dst, const char* obj_path, int n_chunks);
+
+// Write the prepared chunk and its levels of detail, of which there may be no more than
+// CHUNK_CACHE_MAX_LEVELS, to the cache as it is built. The chunk's entry in the table may be read,
+// and its levels loaded, once this returns true.
+bool chunk_cache_write_chunk(chunk_cache_t* cache, int chunk, const mesh_t* mesh);
+
+// Write the table of chunks and move the cache into place for the .obj file at obj_path. The cache
+// remains open to be read from. Failure is reported but otherwise harmless, since the mesh will be
+// built again next time.
+void chunk_cache_finish(chunk_cache_t* cache, const char* obj_path);
+
+// Read the given level of detail of the chunk into memory and load it into dst as mesh_cache_load
+// does, after checking it in the same way. Returns the memory the level's arrays view, which must be
+// freed once dst is, or NULL if the level can't be read or is corrupt. Levels may be loaded while the
+// cache is built.
+void* chunk_cache_load_level(const chunk_cache_t* cache, int chunk, int level, mesh_t* dst);
+
+// Close the cache and free the memory associated with it. A cache that was never finished is
+// removed.
+void chunk_cache_close(chunk_cache_t* cache);
+
+#endif
@@ -0,0 +1,531 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#include "cluster.h"
+#include "edge.h"
+#include "mesh.h"
+#include "must.h"
+#include "sort.h"
+#include "stream.h"
+
+// Maximum number of faces per cluster. Smaller clusters fit their faces more tightly, while larger
+// ones amortize the cost of testing them over more faces.
+#define CLUSTER_MAX_FACES 128
+
+// Minimum cosine of the angle between the normal of a face and the mean normal of the cluster it
+// joins. Keeping the normals of a cluster close together keeps its normal cone narrow.
+#define CLUSTER_MIN_NORMAL_DOT 0.5f
+
+// Number of bits per axis of the quantized face centroids used to order cluster seeds.
+#define MORTON_BITS 10
+
+// Number of recently used vertices whose reuse the order of faces within a cluster is optimized for.
+#define TIPSIFY_CACHE_SIZE 16
+
+// corner_pairs_t identifies each distinct pair of position and tex coord used by a corner of a mesh's
+// faces, which becomes a vertex of every cluster whose faces use it.
+typedef struct corner_pairs_t {
+	int* corners; // index of the pair used by each corner, three per face in the order of the faces
+	int* positions; // index of each pair's position in the mesh's vertices
+	int* uvs; // index of each pair's tex coord in the mesh's tex coords
+	int len;
+} corner_pairs_t;
+
+static bool is_zero(vec3_t v) {
+	return v.x == 0 && v.y == 0 && v.z == 0;
+}
+
+static vec3_t face_centroid(const mesh_t* mesh, const mesh_face_t* f) {
+	vec3_t a = mesh->vertices[f->a];
+	vec3_t b = mesh->vertices[f->b];
+	vec3_t c = mesh->vertices[f->c];
+	return (vec3_t){ (a.x + b.x + c.x) / 3, (a.y + b.y + c.y) / 3, (a.z + b.z + c.z) / 3 };
+}
+
+// Spreads the low 10 bits of v so that two zero bits separate each of them.
+static uint32_t spread_bits(uint32_t v) {
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+static uint32_t quantize_axis(float v, float min, float scale) {
+	float q = (v - min) * scale;
+	return q <= 0 ? 0 : q >= (1 << MORTON_BITS) - 1 ? (1 << MORTON_BITS) - 1 : (uint32_t)q;
+}
+
+// morton_order returns the index of every face in the order of its centroid along a Z-order curve
+// through the mesh's bounding box, so that faces near each other in the order are near each other in
+// space. The depth key sort is reused to sort the curve positions.
+static int* morton_order(const mesh_t* mesh) {
+	int n_faces = array_len(mesh->faces);
+	vec3_t* centroids = must_malloc(sizeof(vec3_t) * n_faces);
+	vec3_t min = { INFINITY, INFINITY, INFINITY };
+	vec3_t max = { -INFINITY, -INFINITY, -INFINITY };
+	for (int i = 0; i < n_faces; i++) {
+		vec3_t c = face_centroid(mesh, &mesh->faces[i]);
+		centroids[i] = c;
+		min = (vec3_t){ fminf(min.x, c.x), fminf(min.y, c.y), fminf(min.z, c.z) };
+		max = (vec3_t){ fmaxf(max.x, c.x), fmaxf(max.y, c.y), fmaxf(max.z, c.z) };
+	}
+
+	float size = fmaxf(max.x - min.x, fmaxf(max.y - min.y, max.z - min.z));
+	float scale = size > 0 ? (1 << MORTON_BITS) / size : 0;
+	depth_key_t* keys = must_malloc(sizeof(depth_key_t) * n_faces);
+	depth_key_t* scratch = must_malloc(sizeof(depth_key_t) * n_faces);
+	for (int i = 0; i < n_faces; i++) {
+		vec3_t c = centroids[i];
+		uint32_t code = spread_bits(quantize_axis(c.x, min.x, scale)) |
+			spread_bits(quantize_axis(c.y, min.y, scale)) << 1 |
+			spread_bits(quantize_axis(c.z, min.z, scale)) << 2;
+		keys[i] = (depth_key_t){ .depth = code, .index = i };
+	}
+
+	const depth_key_t* sorted = radix_sort_depth_keys(keys, scratch, n_faces);
+	int* order = must_malloc(sizeof(int) * n_faces);
+	for (int i = 0; i < n_faces; i++) {
+		order[i] = sorted[i].index;
+	}
+
+	free(scratch);
+	free(keys);
+	free(centroids);
+	return order;
+}
+
+// Returns true if a face with the given normal may join a cluster whose normals sum to normal_sum.
+// Faces with no area have no normal and may join any cluster.
+static bool joins_cluster(vec3_t normal, vec3_t normal_sum) {
+	if (is_zero(normal) || is_zero(normal_sum)) {
+		return true;
+	}
+	return vec3_dot(&normal, &normal_sum) >= CLUSTER_MIN_NORMAL_DOT * vec3_magnitude(&normal_sum);
+}
+
+// new_cluster bounds the faces at the given indices with a sphere centered on their bounding box and
+// a cone around their mean normal.
+static cluster_t new_cluster(const mesh_t* mesh, const int* faces, int n_faces) {
+	vec3_t min = { INFINITY, INFINITY, INFINITY };
+	vec3_t max = { -INFINITY, -INFINITY, -INFINITY };
+	vec3_t normal_sum = { 0, 0, 0 };
+	for (int i = 0; i < n_faces; i++) {
+		const mesh_face_t* f = &mesh->faces[faces[i]];
+		int corners[3] = { f->a, f->b, f->c };
+		for (int j = 0; j < 3; j++) {
+			vec3_t v = mesh->vertices[corners[j]];
+			min = (vec3_t){ fminf(min.x, v.x), fminf(min.y, v.y), fminf(min.z, v.z) };
+			max = (vec3_t){ fmaxf(max.x, v.x), fmaxf(max.y, v.y), fmaxf(max.z, v.z) };
+		}
+		normal_sum = vec3_add(&normal_sum, &mesh->normals[faces[i]]);
+	}
+
+	cluster_t c = {
+		.center = { (min.x + max.x) / 2, (min.y + max.y) / 2, (min.z + max.z) / 2 },
+		.radius = 0,
+		.cone_axis = { 0, 0, 0 },
+		.cone_sin = 1,
+		.n_faces = n_faces,
+	};
+	for (int i = 0; i < n_faces; i++) {
+		const mesh_face_t* f = &mesh->faces[faces[i]];
+		int corners[3] = { f->a, f->b, f->c };
+		for (int j = 0; j < 3; j++) {
+			vec3_t offset = vec3_sub(&mesh->vertices[corners[j]], &c.center);
+			c.radius = fmaxf(c.radius, vec3_magnitude(&offset));
+		}
+	}
+
+	if (is_zero(normal_sum)) {
+		return c;
+	}
+	c.cone_axis = vec3_normalize(&normal_sum);
+	float min_dot = 1;
+	for (int i = 0; i < n_faces; i++) {
+		vec3_t normal = mesh->normals[faces[i]];
+		if (!is_zero(normal)) {
+			min_dot = fminf(min_dot, vec3_dot(&normal, &c.cone_axis));
+		}
+	}
+	if (min_dot > 0) {
+		c.cone_sin = sqrtf(1 - min_dot * min_dot);
+	}
+	return c;
+}
+
+// tipsify_next_vertex chooses the vertex from which to emit the next faces: the candidate with faces
+// left to emit that has been in the cache longest without being evicted before those faces are
+// emitted, or failing that, the most recently used vertex with faces left on the dead-end stack, or
+// failing that, the first vertex with faces left.
+static int tipsify_next_vertex(
+	const int* candidates,
+	int n_candidates,
+	const int* live,
+	const int* cache_time,
+	int time,
+	int* dead_end,
+	int* n_dead_end,
+	int* cursor,
+	int n_vertices
+) {
+	int best = -1;
+	int best_priority = 0;
+	for (int i = 0; i < n_candidates; i++) {
+		int v = candidates[i];
+		// Candidates that would be evicted before their faces are emitted are left to the dead-end
+		// stack.
+		if (live[v] == 0 || time - cache_time[v] + 2 * live[v] > TIPSIFY_CACHE_SIZE) {
+			continue;
+		}
+		int priority = time - cache_time[v];
+		if (priority > best_priority) {
+			best_priority = priority;
+			best = v;
+		}
+	}
+	if (best >= 0) {
+		return best;
+	}
+
+	while (*n_dead_end > 0) {
+		int v = dead_end[--*n_dead_end];
+		if (live[v] > 0) {
+			return v;
+		}
+	}
+	for (; *cursor < n_vertices; (*cursor)++) {
+		if (live[*cursor] > 0) {
+			return *cursor;
+		}
+	}
+	return -1;
+}
+
+// tipsify reorders the faces at the given indices, at most CLUSTER_MAX_FACES of them, so that faces
+// sharing vertices are close together, following Sander, Nehab and Barczak's Tipsify. It emits every
+// remaining face around one vertex at a time, simulating a FIFO cache of TIPSIFY_CACHE_SIZE vertices,
+// then moves on to a vertex of those faces that is still cached. Vertices are the pairs used by the
+// faces' corners. last_face and local_index are scratch space indexed like the pairs, in which
+// last_face must hold no index in faces.
+static void tipsify(const corner_pairs_t* pairs, int* faces, int n_faces, int* last_face, int* local_index) {
+	int corners[CLUSTER_MAX_FACES * 3];
+	int n_vertices = 0;
+	for (int i = 0; i < n_faces; i++) {
+		for (int j = 0; j < 3; j++) {
+			int v = pairs->corners[faces[i] * 3 + j];
+			// Faces of other clusters never come first, so their indices can't match.
+			if (last_face[v] != faces[0]) {
+				last_face[v] = faces[0];
+				local_index[v] = n_vertices++;
+			}
+			corners[i * 3 + j] = local_index[v];
+		}
+	}
+
+	// Build the list of faces around each vertex.
+	int live[CLUSTER_MAX_FACES * 3 + 1] = { 0 };
+	int first_adjacent[CLUSTER_MAX_FACES * 3 + 1] = { 0 };
+	int adjacent[CLUSTER_MAX_FACES * 3];
+	for (int i = 0; i < n_faces * 3; i++) {
+		live[corners[i]]++;
+	}
+	for (int v = 0; v < n_vertices; v++) {
+		first_adjacent[v + 1] = first_adjacent[v] + live[v];
+	}
+	int fill[CLUSTER_MAX_FACES * 3];
+	memcpy(fill, first_adjacent, sizeof(int) * n_vertices);
+	for (int i = 0; i < n_faces * 3; i++) {
+		adjacent[fill[corners[i]]++] = i / 3;
+	}
+
+	int cache_time[CLUSTER_MAX_FACES * 3] = { 0 };
+	bool is_emitted[CLUSTER_MAX_FACES] = { false };
+	int dead_end[CLUSTER_MAX_FACES * 3];
+	int candidates[CLUSTER_MAX_FACES * 3];
+	int order[CLUSTER_MAX_FACES];
+	int n_dead_end = 0, n_ordered = 0, cursor = 1;
+	int time = TIPSIFY_CACHE_SIZE + 1;
+	for (int v = n_faces > 0 ? 0 : -1; v >= 0; ) {
+		int n_candidates = 0;
+		for (int i = first_adjacent[v]; i < first_adjacent[v + 1]; i++) {
+			int face = adjacent[i];
+			if (is_emitted[face]) {
+				continue;
+			}
+			is_emitted[face] = true;
+			order[n_ordered++] = face;
+			for (int j = 0; j < 3; j++) {
+				int u = corners[face * 3 + j];
+				dead_end[n_dead_end++] = u;
+				candidates[n_candidates++] = u;
+				live[u]--;
+				if (time - cache_time[u] > TIPSIFY_CACHE_SIZE) {
+					cache_time[u] = time++;
+				}
+			}
+		}
+		v = tipsify_next_vertex(
+			candidates, n_candidates, live, cache_time, time, dead_end, &n_dead_end, &cursor, n_vertices
+		);
+	}
+
+	int reordered[CLUSTER_MAX_FACES];
+	for (int i = 0; i < n_faces; i++) {
+		reordered[i] = faces[order[i]];
+	}
+	memcpy(faces, reordered, sizeof(int) * n_faces);
+}
+
+// Returns the bits of the tex coord as a single key, so that tex coords compare equal only if they
+// have the same value.
+static uint64_t tex_coord_bits(tex2_t uv) {
+	uint32_t u, v;
+	memcpy(&u, &uv.u, sizeof(u));
+	memcpy(&v, &uv.v, sizeof(v));
+	return ((uint64_t)u << 32) | v;
+}
+
+// Mixes the bits of the key so that neighbouring tex coords spread across a hash table.
+static uint32_t tex_coord_hash(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+// canonical_tex_coords returns the index of the first of the mesh's tex coords with the same value as
+// each of them, so that identical tex coords listed separately weld into one vertex.
+static int* canonical_tex_coords(const mesh_t* mesh) {
+	int n_tex_coords = array_len(mesh->tex_coords);
+	int* canonical = must_malloc(sizeof(int) * (n_tex_coords + 1));
+
+	// An open addressing table of the first index of each distinct tex coord, at a load factor of at
+	// most one half. Every bit pattern is a valid tex coord, so slots are marked empty by holding no
+	// index rather than by a reserved key.
+	int capacity = 16;
+	while (capacity < n_tex_coords * 2) {
+		capacity *= 2;
+	}
+	int* firsts = must_malloc(sizeof(int) * capacity);
+	for (int i = 0; i < capacity; i++) {
+		firsts[i] = -1;
+	}
+	uint32_t mask = capacity - 1;
+	for (int i = 0; i < n_tex_coords; i++) {
+		uint64_t key = tex_coord_bits(mesh->tex_coords[i]);
+		uint32_t slot = tex_coord_hash(key) & mask;
+		while (firsts[slot] >= 0 && tex_coord_bits(mesh->tex_coords[firsts[slot]]) != key) {
+			slot = (slot + 1) & mask;
+		}
+		if (firsts[slot] < 0) {
+			firsts[slot] = i;
+		}
+		canonical[i] = firsts[slot];
+	}
+	free(firsts);
+	return canonical;
+}
+
+// pair_corners welds the corners of the mesh's faces that share both a position and the value of a
+// tex coord.
+static corner_pairs_t pair_corners(const mesh_t* mesh) {
+	int n_corners = array_len(mesh->faces) * 3;
+	int* canonical_uvs = canonical_tex_coords(mesh);
+	corner_pairs_t pairs = {
+		.corners = must_malloc(sizeof(int) * (n_corners + 1)),
+		.positions = must_malloc(sizeof(int) * (n_corners + 1)),
+		.uvs = must_malloc(sizeof(int) * (n_corners + 1)),
+		.len = 0,
+	};
+	// The edge table doubles as a map from pairs of position and tex coord to an index of the pair.
+	// Like the vertex indices of an edge, position and tex coord indices are never negative.
+	edge_table_t indices = new_edge_table(n_corners);
+	for (int i = 0; i < n_corners / 3; i++) {
+		const mesh_face_t* f = &mesh->faces[i];
+		const mesh_face_t* f_uvs = &mesh->face_uvs[i];
+		int positions[3] = { f->a, f->b, f->c };
+		int uvs[3] = { f_uvs->a, f_uvs->b, f_uvs->c };
+		for (int j = 0; j < 3; j++) {
+			int position = positions[j];
+			int uv = canonical_uvs[uvs[j]];
+			int pair = edge_table_find(&indices, position, uv);
+			if (pair < 0) {
+				pair = pairs.len++;
+				edge_table_insert(&indices, position, uv, pair);
+				pairs.positions[pair] = position;
+				pairs.uvs[pair] = uv;
+			}
+			pairs.corners[i * 3 + j] = pair;
+		}
+	}
+	edge_table_free(&indices);
+	free(canonical_uvs);
+	return pairs;
+}
+
+static void corner_pairs_free(corner_pairs_t* pairs) {
+	free(pairs->corners);
+	free(pairs->positions);
+	free(pairs->uvs);
+}
+
+// localize_vertices gives each cluster a vertex of its own for each pair used by its faces, whose tex
+// coord is stored alongside its position so that faces need a single index per corner. The vertices of
+// a cluster are stored in the order its faces first use them, starting on a stream lane boundary, so
+// that the vertex stage can transform the vertices of visible clusters alone in whole batches.
+static void localize_vertices(mesh_t* mesh, const corner_pairs_t* pairs) {
+	int* last_cluster = must_malloc(sizeof(int) * (pairs->len + 1));
+	int* local_index = must_malloc(sizeof(int) * (pairs->len + 1));
+	for (int i = 0; i < pairs->len; i++) {
+		last_cluster[i] = -1;
+	}
+
+	vec3_t* vertices = NULL;
+	tex2_t* tex_coords = NULL;
+	int n_clusters = array_len(mesh->clusters);
+	for (int i = 0; i < n_clusters; i++) {
+		cluster_t* c = &mesh->clusters[i];
+		while (array_len(vertices) % STREAM_LANES != 0) {
+			vec3_t padding = { 0, 0, 0 };
+			tex2_t padding_uv = { 0, 0 };
+			array_push(vertices, padding);
+			array_push(tex_coords, padding_uv);
+		}
+		c->first_vertex = array_len(vertices);
+
+		for (int j = 0; j < c->n_faces; j++) {
+			int face_index = c->first_face + j;
+			mesh_face_t* f = &mesh->faces[face_index];
+			uint32_t* corners[3] = { &f->a, &f->b, &f->c };
+			for (int k = 0; k < 3; k++) {
+				int pair = pairs->corners[face_index * 3 + k];
+				if (last_cluster[pair] != i) {
+					last_cluster[pair] = i;
+					local_index[pair] = array_len(vertices);
+					array_push(vertices, mesh->vertices[pairs->positions[pair]]);
+					array_push(tex_coords, mesh->tex_coords[pairs->uvs[pair]]);
+				}
+				*corners[k] = local_index[pair];
+			}
+		}
+		c->n_vertices = array_len(vertices) - c->first_vertex;
+	}
+
+	array_free(mesh->vertices);
+	array_free(mesh->tex_coords);
+	mesh->vertices = vertices;
+	mesh->tex_coords = tex_coords;
+	free(local_index);
+	free(last_cluster);
+}
+
+// cluster_build seeds each cluster with the first unclustered face along a Z-order curve, then grows
+// it breadth first across shared edges to neighbouring faces with similar normals until it is full
+// or no such neighbour remains. The faces of each full cluster are then reordered for vertex reuse.
+void cluster_build(mesh_t* mesh) {
+	int n_faces = array_len(mesh->faces);
+	edge_table_t edges = new_edge_table(n_faces * 3);
+	for (int i = 0; i < n_faces; i++) {
+		const mesh_face_t* f = &mesh->faces[i];
+		edge_table_insert(&edges, f->a, f->b, i);
+		edge_table_insert(&edges, f->b, f->c, i);
+		edge_table_insert(&edges, f->c, f->a, i);
+	}
+
+	int* seeds = morton_order(mesh);
+	bool* assigned = must_calloc(n_faces, sizeof(bool));
+	int* queue = must_malloc(sizeof(int) * n_faces);
+	int* order = must_malloc(sizeof(int) * n_faces);
+	int n_ordered = 0;
+	corner_pairs_t pairs = pair_corners(mesh);
+	// Once welded, each face's tex coords are found through its pairs.
+	array_free(mesh->face_uvs);
+	mesh->face_uvs = NULL;
+	int* last_face = must_malloc(sizeof(int) * (pairs.len + 1));
+	int* local_index = must_malloc(sizeof(int) * (pairs.len + 1));
+	for (int i = 0; i < pairs.len; i++) {
+		last_face[i] = -1;
+	}
+	array_reset(mesh->clusters, sizeof(cluster_t));
+	for (int s = 0; s < n_faces; s++) {
+		if (assigned[seeds[s]]) {
+			continue;
+		}
+
+		int first = n_ordered;
+		int head = 0, tail = 0;
+		vec3_t normal_sum = { 0, 0, 0 };
+		queue[tail++] = seeds[s];
+		assigned[seeds[s]] = true;
+		while (head < tail && n_ordered - first < CLUSTER_MAX_FACES) {
+			int face_index = queue[head++];
+			order[n_ordered++] = face_index;
+			normal_sum = vec3_add(&normal_sum, &mesh->normals[face_index]);
+
+			const mesh_face_t* f = &mesh->faces[face_index];
+			int corners[3] = { f->a, f->b, f->c };
+			for (int j = 0; j < 3; j++) {
+				// The neighbour across an edge traverses it in the opposite direction.
+				int neighbour = edge_table_find(&edges, corners[(j + 1) % 3], corners[j]);
+				if (neighbour < 0 || assigned[neighbour] || !joins_cluster(mesh->normals[neighbour], normal_sum)) {
+					continue;
+				}
+				assigned[neighbour] = true;
+				queue[tail++] = neighbour;
+			}
+		}
+		// Faces queued after the cluster filled up are left for later clusters.
+		while (head < tail) {
+			assigned[queue[head++]] = false;
+		}
+
+		tipsify(&pairs, &order[first], n_ordered - first, last_face, local_index);
+		cluster_t c = new_cluster(mesh, &order[first], n_ordered - first);
+		c.first_face = first;
+		array_push(mesh->clusters, c);
+	}
+
+	mesh_reorder_faces(mesh, order);
+	array_reset(mesh->face_clusters, sizeof(int));
+	mesh->face_clusters = array_hold(mesh->face_clusters, n_faces, sizeof(int));
+	int n_clusters = array_len(mesh->clusters);
+	for (int i = 0; i < n_clusters; i++) {
+		const cluster_t* c = &mesh->clusters[i];
+		for (int j = 0; j < c->n_faces; j++) {
+			mesh->face_clusters[c->first_face + j] = i;
+		}
+	}
+	// The corners' pairs follow their faces to their new order.
+	int* corners = must_malloc(sizeof(int) * (n_faces * 3 + 1));
+	for (int i = 0; i < n_faces; i++) {
+		for (int j = 0; j < 3; j++) {
+			corners[i * 3 + j] = pairs.corners[order[i] * 3 + j];
+		}
+	}
+	free(pairs.corners);
+	pairs.corners = corners;
+	localize_vertices(mesh, &pairs);
+
+	corner_pairs_free(&pairs);
+	free(local_index);
+	free(last_face);
+	free(order);
+	free(queue);
+	free(assigned);
+	free(seeds);
+	edge_table_free(&edges);
+}
+
+// cluster_is_backfacing conservatively tests every point p of the bounding sphere against every
+// normal n in the cone. Each face is culled when dot(n, p - eye) > 0, which holds for all n in the
+// cone when the angle between p - eye and the axis is less than 90 degrees minus the cone's
+// half-angle, that is, when dot(axis, p - eye) > cone_sin * |p - eye|. Bounding both sides of this
+// inequality over the sphere gives the test below.
+bool cluster_is_backfacing(const cluster_t* c, vec3_t eye) {
+	vec3_t view = vec3_sub(&c->center, &eye);
+	float distance = vec3_magnitude(&view);
+	return vec3_dot(&c->cone_axis, &view) > c->cone_sin * distance + c->radius * (1 + c->cone_sin);
+}
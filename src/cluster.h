@@ -0,0 +1,46 @@
+// cluster.h provides clusters of neighbouring mesh faces, whose bounds allow every face in a cluster
+// to be rejected with a single test before any per-face work is done.
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdbool.h>
+
+#include "vector.h"
+
+struct mesh_t;
+
+/*
+Structs
+*/
+
+// cluster_t is a run of contiguous mesh faces that are close together and
+// face in similar directions, bounded in model space by a sphere and a cone of face normals.
+typedef struct cluster_t {
+	vec3_t center; // center of the bounding sphere
+	float radius;
+	vec3_t cone_axis; // unit vector within the cone's half-angle of every face normal in the cluster
+	float cone_sin; // sine of the cone's half-angle, or 1 if the normals span a hemisphere or more
+	int first_face; // index of the cluster's first face in the mesh's faces
+	int n_faces;
+	int first_vertex; // index of the cluster's first vertex, a multiple of STREAM_LANES
+	int n_vertices;
+} cluster_t;
+
+/*
+Functions
+*/
+
+// Partitions the faces of the mesh into clusters, reordering the faces and their normals so that the
+// faces of each cluster are contiguous and ordered for vertex reuse, and giving each cluster its own
+// contiguous run of vertices. Each vertex is a distinct pair of position and tex coord, so tex coords
+// are indexed like vertices afterwards. Must be called once the mesh's normals have been built and
+// while its vertex array is still populated. Vertices shared between clusters or split by tex coords
+// are duplicated, so the mesh's faces no longer share edges across cluster borders or UV seams
+// afterwards.
+void cluster_build(struct mesh_t* mesh);
+
+// Returns true if every face of the cluster faces away from the eye, given in model space, so that
+// all of them would be culled.
+bool cluster_is_backfacing(const cluster_t* c, vec3_t eye);
+
+#endif
@@ -63,7 +63,7 @@ void draw_pixel(int x, int y, color_t color) {
 	g_color_buffer[g_window_width * y + x] = color;
 }
 
-void draw_texel(int x, int y, const triangle_t* t, const uint32_t* texture) {
+void draw_texel(int x, int y, const triangle_t* t, const texture_t* texture) {
 	// Calculate the UV coordinates for the point based on its position relative to the vertices of
 	// the triangle.
 	vec3_t weights = triangle_barycentric_weights(t, (vec2_t){x, y});
@@ -78,29 +78,25 @@ void draw_texel(int x, int y, const triangle_t* t, const uint32_t* texture) {
 	tex2_t uv_b = t->tex_coords[1];
 	tex2_t uv_c = t->tex_coords[2];
 
-	const vec4_t* a = triangle_vertex_a(t);
-	const vec4_t* b = triangle_vertex_b(t);
-	const vec4_t* c = triangle_vertex_c(t);
-
 	// Calculate perspective-correct UV coordinates using a single divsion.
-	float i = alpha * b->w * c->w;
-	float j = beta * a->w * c->w;
-	float k = gamma * a->w * b->w;
+	float i = alpha * t->inv_w[0];
+	float j = beta * t->inv_w[1];
+	float k = gamma * t->inv_w[2];
 	float recip_divisor = 1 / (i + j + k);
 	float interpolated_u = (uv_a.u * i + uv_b.u * j + uv_c.u * k) * recip_divisor;
 	float interpolated_v = (uv_a.v * i + uv_b.v * j + uv_c.v * k) * recip_divisor;
 
 	// Map the UV coordinates to a pixel in the texture.
-	int texture_x = abs((int)(interpolated_u * g_texture_width));
-	int texture_y = abs((int)(interpolated_v * g_texture_height));
+	int texture_x = abs((int)(interpolated_u * texture->width));
+	int texture_y = abs((int)(interpolated_v * texture->height));
 	// Due to our imperfect pixel representation of a real triangle, our barycentric weights or UV
 	// interpolation may sometimes indicate that the point lies outside the triangle. We don't
 	// handle this case, which may result in small gaps appearing between faces. GPUs implement
 	// proper fill convention rules to prevent this.
-	if (texture_x < 0 || texture_x >= g_texture_width || texture_y < 0 || texture_y >= g_texture_height) {
+	if (texture_x < 0 || texture_x >= texture->width || texture_y < 0 || texture_y >= texture->height) {
 		return;
 	}
-	draw_pixel(x, y, texture[g_texture_width * texture_y + texture_x]);
+	draw_pixel(x, y, texture->pixels[texture->width * texture_y + texture_x]);
 }
 
 void draw_line(vec2_t a, vec2_t b, color_t color) {
@@ -125,7 +121,7 @@ void draw_line(vec2_t a, vec2_t b, color_t color) {
 	}
 }
 
-void draw_rectangle(const vec4_t* p, int w, int h, color_t color) {
+void draw_rectangle(const vec2_t* p, int w, int h, color_t color) {
 	for (int i = 0; i < w; i++) {
 		int cur_x = p->x + i;
 		for (int j = 0; j < h; j++) {
@@ -136,14 +132,14 @@ void draw_rectangle(const vec4_t* p, int w, int h, color_t color) {
 }
 
 void draw_triangle(const triangle_t* t) {
-	draw_line(vec2_from_vec4(triangle_vertex_a(t)), vec2_from_vec4(triangle_vertex_b(t)), t->border);
-	draw_line(vec2_from_vec4(triangle_vertex_b(t)), vec2_from_vec4(triangle_vertex_c(t)), t->border);
-	draw_line(vec2_from_vec4(triangle_vertex_c(t)), vec2_from_vec4(triangle_vertex_a(t)), t->border);
+	draw_line(*triangle_vertex_a(t), *triangle_vertex_b(t), t->border);
+	draw_line(*triangle_vertex_b(t), *triangle_vertex_c(t), t->border);
+	draw_line(*triangle_vertex_c(t), *triangle_vertex_a(t), t->border);
 }
 
 void render_triangle_vertices(const triangle_t* t) {
 	for (int j = 0; j < 3; j++) {
-		draw_rectangle(&t->vertices[j], VERTEX_RECT_WIDTH_PX, VERTEX_RECT_WIDTH_PX, DEFAULT_VERTEX_COLOR);
+		draw_rectangle(&t->points[j], VERTEX_RECT_WIDTH_PX, VERTEX_RECT_WIDTH_PX, DEFAULT_VERTEX_COLOR);
 	}
 }
 
@@ -170,9 +166,9 @@ void fill_triangle(triangle_t* t) {
 	// triangle. We know that y (representing the current scan line) will increase monotonically –
 	// the change in x is our unknown.
 	triangle_sort_vertices_by_y(t);
-	vec2_t a = vec2_from_vec4(triangle_vertex_a(t));
-	vec2_t b = vec2_from_vec4(triangle_vertex_b(t));
-	vec2_t c = vec2_from_vec4(triangle_vertex_c(t));
+	vec2_t a = *triangle_vertex_a(t);
+	vec2_t b = *triangle_vertex_b(t);
+	vec2_t c = *triangle_vertex_c(t);
 	vec2_t m = triangle_b_hyp_intercept(t); // the point at which a line projected horizontally from b intercepts ac
 	float inv_m_ab = vec2_inv_gradient(a, b);
 	float inv_m_bc = vec2_inv_gradient(b, c);
@@ -223,14 +219,14 @@ void fill_triangle_with_wireframe(triangle_t* t) {
 //                   \_ \
 //                      c
 //
-void texture_triangle(triangle_t* t, const uint32_t* texture) {
+void texture_triangle(triangle_t* t, const texture_t* texture) {
 	// Calculate the change in x with respect to y (inverse gradient) for both opposing sides of the
 	// triangle. We know that y (representing the current scan line) will increase monotonically –
 	// the change in x is our unknown.
 	triangle_sort_vertices_by_y(t);
-	vec2_t a = vec2_from_vec4(triangle_vertex_a(t));
-	vec2_t b = vec2_from_vec4(triangle_vertex_b(t));
-	vec2_t c = vec2_from_vec4(triangle_vertex_c(t));
+	vec2_t a = *triangle_vertex_a(t);
+	vec2_t b = *triangle_vertex_b(t);
+	vec2_t c = *triangle_vertex_c(t);
 	vec2_t m = triangle_b_hyp_intercept(t); // the point at which a line projected horizontally from b intercepts ac
 	float inv_m_ab = vec2_inv_gradient(a, b);
 	float inv_m_bc = vec2_inv_gradient(b, c);
@@ -261,17 +257,18 @@ void texture_triangle(triangle_t* t, const uint32_t* texture) {
 	}
 }
 
-void texture_triangle_with_wireframe(triangle_t* t, const uint32_t* texture) {
+void texture_triangle_with_wireframe(triangle_t* t, const texture_t* texture) {
 	t->border = WHITE;
 	texture_triangle(t, texture);
 	draw_triangle(t);
 }
 
 // render_triangle renders the given triangle to the screen based on the current rendering mode.
-void render_triangle(triangle_t* t) {
-	// Truncating floating point vertices to integers at the outset avoids a host of downstream
-	// floating-point issues when drawing to the screen.
-	triangle_truncate_xy_components(t);
+void render_triangle(const packed_triangle_t* p, const triangle_uv_t* uv) {
+	// Unpacking truncates the vertices to whole pixels at the outset, which avoids a host of
+	// downstream floating-point issues when drawing to the screen.
+	triangle_t triangle = triangle_unpack(p, uv);
+	triangle_t* t = &triangle;
 	if (!triangle_is_renderable(t)) {
 		return;
 	}
@@ -290,16 +287,29 @@ void render_triangle(triangle_t* t) {
 		fill_triangle(t);
 		break;
 	case RENDER_MODE_TEXTURE:
-		texture_triangle(t, g_mesh_texture);
+		// Triangles of untextured meshes are filled instead.
+		if (t->texture == NULL) {
+			fill_triangle(t);
+		} else {
+			texture_triangle(t, t->texture);
+		}
 		break;
 	case RENDER_MODE_TEXTURE_WIREFRAME:
-		texture_triangle_with_wireframe(t, g_mesh_texture);
+		if (t->texture == NULL) {
+			fill_triangle_with_wireframe(t);
+		} else {
+			texture_triangle_with_wireframe(t, t->texture);
+		}
 		break;
 	default:
 		fill_triangle_with_wireframe(t);
 	}
 }
 
+bool render_mode_is_textured(void) {
+	return g_render_mode == RENDER_MODE_TEXTURE || g_render_mode == RENDER_MODE_TEXTURE_WIREFRAME;
+}
+
 // render_color_buffer copies the contents to the global color buffer to the SDL texture.
 void render_color_buffer(void) {
 	SDL_UpdateTexture(
@@ -82,8 +82,12 @@ Functions
 // Initialize the global SDL window.
 bool initialize_window(void);
 
-// Render a triangle to the global color buffer according to the current render mode.
-void render_triangle(triangle_t* t);
+// Render a packed triangle to the global color buffer according to the current render mode. uv holds
+// its texture mapping, and may be NULL if the triangle is not textured.
+void render_triangle(const packed_triangle_t* p, const triangle_uv_t* uv);
+
+// Returns true if the current render mode maps textures onto triangles.
+bool render_mode_is_textured(void);
 
 // Render the color buffer to the global SDL texture.
 void render_color_buffer(void);
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+
+#include "edge.h"
+#include "must.h"
+
+// Marks an unused slot. Vertex indices are never negative, so no edge has this key.
+#define EDGE_EMPTY UINT64_MAX
+
+static uint64_t edge_key(int from, int to) {
+	return ((uint64_t)(uint32_t)from << 32) | (uint32_t)to;
+}
+
+// Mixes the bits of the key so that edges between neighbouring vertices spread across the table.
+static uint32_t edge_hash(uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xFF51AFD7ED558CCDull;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+edge_table_t new_edge_table(int n_edges) {
+	// Keep the load factor at or below one half so that probe sequences stay short.
+	int capacity = 16;
+	while (capacity < n_edges * 2) {
+		capacity *= 2;
+	}
+
+	edge_table_t t = {
+		.keys = must_malloc(sizeof(uint64_t) * capacity),
+		.faces = must_malloc(sizeof(int) * capacity),
+		.capacity = capacity,
+	};
+	for (int i = 0; i < capacity; i++) {
+		t.keys[i] = EDGE_EMPTY;
+	}
+	return t;
+}
+
+bool edge_table_insert(edge_table_t* t, int from, int to, int face) {
+	uint64_t key = edge_key(from, to);
+	uint32_t mask = t->capacity - 1;
+	for (uint32_t i = edge_hash(key) & mask; ; i = (i + 1) & mask) {
+		if (t->keys[i] == key) {
+			return false;
+		}
+		if (t->keys[i] == EDGE_EMPTY) {
+			t->keys[i] = key;
+			t->faces[i] = face;
+			return true;
+		}
+	}
+}
+
+int edge_table_find(const edge_table_t* t, int from, int to) {
+	uint64_t key = edge_key(from, to);
+	uint32_t mask = t->capacity - 1;
+	for (uint32_t i = edge_hash(key) & mask; t->keys[i] != EDGE_EMPTY; i = (i + 1) & mask) {
+		if (t->keys[i] == key) {
+			return t->faces[i];
+		}
+	}
+	return -1;
+}
+
+void edge_table_free(edge_table_t* t) {
+	free(t->keys);
+	free(t->faces);
+	t->keys = NULL;
+	t->faces = NULL;
+	t->capacity = 0;
+}
@@ -0,0 +1,36 @@
+// edge.h provides a hash table of directed mesh edges, used to find the faces adjacent to each face.
+#ifndef EDGE_H
+#define EDGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Structs
+*/
+
+// edge_table_t maps each directed edge, given as a pair of vertex indices, to the face it belongs to.
+typedef struct edge_table_t {
+	uint64_t* keys;
+	int* faces;
+	int capacity; // always a power of 2
+} edge_table_t;
+
+/*
+Functions
+*/
+
+// Construct an empty edge table with space for at least n_edges edges.
+edge_table_t new_edge_table(int n_edges);
+
+// Records that the edge from vertex from to vertex to belongs to face. Returns false without
+// modifying the table if the edge is already present.
+bool edge_table_insert(edge_table_t* t, int from, int to, int face);
+
+// Returns the face that the edge from vertex from to vertex to belongs to, or -1 if there is none.
+int edge_table_find(const edge_table_t* t, int from, int to);
+
+// Free the memory associated with the table, after which it must not be used.
+void edge_table_free(edge_table_t* t);
+
+#endif
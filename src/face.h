@@ -5,19 +5,18 @@
 #include <stdbool.h>
 
 #include "color.h"
-#include "light.h"
 #include "mesh.h"
-#include "texture.h"
 #include "vector.h"
 
 /*
 Structs
 */
 
-// face_t represents a triangular plane in 3D space.
+// face_t represents a triangular plane of a mesh in model space, carrying what the face stage needs
+// to decide whether and how brightly it is drawn.
 typedef struct face_t {
-	vec3_t vertices[3];
-	tex2_t tex_coords[3];
+	vec3_t a; // the face's first vertex
+	vec3_t normal;
 	color_t color;
 } face_t;
 
@@ -26,32 +25,14 @@ typedef struct face_t {
 Functions
 */
 
-// Construct a new face from its mesh counterpart.
-face_t new_face_from_mesh_face(const mesh_face_t* mf);
+// Construct a new face from the mesh face at the given index, using the mesh's precomputed normal.
+face_t new_face_from_mesh_face(const mesh_t* mesh, int face_index);
 
-// Getters to expedite vertex lookup.
-vec3_t face_vertex_a(const face_t* f);
-vec3_t face_vertex_b(const face_t* f);
-vec3_t face_vertex_c(const face_t* f);
-
-// Getters to expedite tex lookup.
-vec3_t face_tex_a(const face_t* f);
-vec3_t face_tex_b(const face_t* f);
-vec3_t face_tex_c(const face_t* f);
-
-// Transform the face by the given matrix.
-void face_transform(face_t* f, const mat4_t* m);
-
-// Returns true if the face is out of view and should be culled.
+// Returns true if the face points away from the camera, given in model space, and should be culled.
 bool face_should_cull(const face_t* f, vec3_t camera_pos);
 
-// Returns the normal to the face.
-vec3_t face_normal(const face_t* f);
-
-// Updates the face's color based on its illumination by the given light sources.
-void face_illuminate(face_t* f, const light_t* l);
-
-// Returns the average of the z-components of the face's vertices.
-float face_avg_depth(const face_t* face);
+// Updates the face's color based on its illumination by a directional light. light_direction is the
+// unit vector pointing towards the light in model space.
+void face_illuminate(face_t* f, vec3_t light_direction);
 
-#endif
\ No newline at end of file
+#endif
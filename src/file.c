@@ -0,0 +1,53 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+
+// map_descriptor maps the whole of the open file into memory.
+static bool map_descriptor(int fd, mapped_file_t* dst) {
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return false;
+	}
+
+	*dst = (mapped_file_t){ .data = NULL, .size = st.st_size };
+	if (dst->size > 0) {
+		void* data = mmap(NULL, dst->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+		dst->data = data;
+	}
+	return true;
+}
+
+bool map_file(const char* path, mapped_file_t* dst) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	bool is_mapped = map_descriptor(fd, dst);
+	if (is_mapped && dst->data != NULL) {
+		posix_madvise((void*)dst->data, dst->size, POSIX_MADV_SEQUENTIAL);
+	}
+	// The mapping outlives the descriptor.
+	close(fd);
+	return is_mapped;
+}
+
+bool map_open_file(FILE* f, mapped_file_t* dst) {
+	return fflush(f) == 0 && map_descriptor(fileno(f), dst);
+}
+
+void unmap_file(mapped_file_t* file) {
+	if (file->data != NULL) {
+		munmap((void*)file->data, file->size);
+	}
+	*file = (mapped_file_t){ 0 };
+}
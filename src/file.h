@@ -0,0 +1,36 @@
+// file.h provides read-only access to whole files mapped into memory, which lets loaders scan large
+// assets in place without copying them through stdio buffers.
+#ifndef FILE_H
+#define FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+Structs
+*/
+
+// mapped_file_t is a read-only view of the contents of a file.
+typedef struct mapped_file_t {
+	const char* data; // NULL if the file is empty
+	size_t size;
+} mapped_file_t;
+
+/*
+Functions
+*/
+
+// Map the whole of the file at path into memory, to be read from start to end. Returns false if the
+// file can't be opened or mapped.
+bool map_file(const char* path, mapped_file_t* dst);
+
+// Map the whole of the open file into memory after flushing what has been written to it, to be read
+// in any order. The mapping outlives the file, which may be closed or removed. Returns false if the
+// file can't be mapped.
+bool map_open_file(FILE* f, mapped_file_t* dst);
+
+// Unmap the file, after which its data must not be used.
+void unmap_file(mapped_file_t* file);
+
+#endif
@@ -0,0 +1,70 @@
+#include "frustum.h"
+
+// Returns the plane with the given coefficients, scaled so that its normal has unit length and the
+// result of the plane equation is the distance from the plane.
+static plane_t new_normalized_plane(float a, float b, float c, float d) {
+	vec3_t normal = { a, b, c };
+	float magnitude = vec3_magnitude(&normal);
+	return (plane_t){
+		.normal = vec3_sdiv(&normal, magnitude),
+		.d = d / magnitude,
+	};
+}
+
+// frustum_from_matrix uses the Gribb-Hartmann method. A clip-space point is visible if
+// -w <= x <= w, -w <= y <= w and 0 <= z <= w, and each of these inequalities is a linear combination
+// of rows of the matrix applied to the untransformed point.
+frustum_t frustum_from_matrix(const mat4_t* m) {
+	const float (*r)[4] = m->m;
+	frustum_t f;
+	for (int i = 0; i < 2; i++) {
+		// Left and bottom, then right and top.
+		f.planes[i * 2] = new_normalized_plane(
+			r[3][0] + r[i][0], r[3][1] + r[i][1], r[3][2] + r[i][2], r[3][3] + r[i][3]
+		);
+		f.planes[i * 2 + 1] = new_normalized_plane(
+			r[3][0] - r[i][0], r[3][1] - r[i][1], r[3][2] - r[i][2], r[3][3] - r[i][3]
+		);
+	}
+	f.planes[4] = new_normalized_plane(r[2][0], r[2][1], r[2][2], r[2][3]); // near
+	f.planes[5] = new_normalized_plane(
+		r[3][0] - r[2][0], r[3][1] - r[2][1], r[3][2] - r[2][2], r[3][3] - r[2][3]
+	); // far
+	return f;
+}
+
+bool frustum_excludes_sphere(const frustum_t* f, vec3_t center, float radius) {
+	for (int i = 0; i < 6; i++) {
+		const plane_t* p = &f->planes[i];
+		if (vec3_dot(&p->normal, &center) + p->d < -radius) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// frustum_classify_box tests the corners of the box farthest in front of and farthest behind each
+// plane. If even the corner farthest in front is behind a plane, so is the whole box.
+frustum_overlap_t frustum_classify_box(const frustum_t* f, vec3_t min, vec3_t max) {
+	frustum_overlap_t overlap = FRUSTUM_INSIDE;
+	for (int i = 0; i < 6; i++) {
+		const plane_t* p = &f->planes[i];
+		vec3_t front = {
+			p->normal.x >= 0 ? max.x : min.x,
+			p->normal.y >= 0 ? max.y : min.y,
+			p->normal.z >= 0 ? max.z : min.z,
+		};
+		vec3_t back = {
+			p->normal.x >= 0 ? min.x : max.x,
+			p->normal.y >= 0 ? min.y : max.y,
+			p->normal.z >= 0 ? min.z : max.z,
+		};
+		if (vec3_dot(&p->normal, &front) + p->d < 0) {
+			return FRUSTUM_OUTSIDE;
+		}
+		if (vec3_dot(&p->normal, &back) + p->d < 0) {
+			overlap = FRUSTUM_INTERSECTS;
+		}
+	}
+	return overlap;
+}
@@ -0,0 +1,49 @@
+// frustum.h provides the planes bounding the visible volume of the scene and tests against them.
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <stdbool.h>
+
+#include "vector.h"
+
+/*
+Structs
+*/
+
+// frustum_overlap_t describes how a volume is positioned relative to the frustum.
+typedef enum frustum_overlap_t {
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE,
+} frustum_overlap_t;
+
+// plane_t contains all points p where dot(normal, p) + d == 0. Points where the sum is positive lie
+// in front of the plane.
+typedef struct plane_t {
+	vec3_t normal;
+	float d;
+} plane_t;
+
+// frustum_t is the volume in front of all six of its planes.
+typedef struct frustum_t {
+	plane_t planes[6];
+} frustum_t;
+
+/*
+Functions
+*/
+
+// Extracts the frustum from a matrix that maps points into clip space, such as the product of the
+// projection and world matrices. The planes are in the space the matrix maps from, so a frustum
+// extracted from the full clip matrix can be tested against bounds in model space.
+frustum_t frustum_from_matrix(const mat4_t* m);
+
+// Returns true if the sphere lies entirely outside the frustum.
+bool frustum_excludes_sphere(const frustum_t* f, vec3_t center, float radius);
+
+// Returns whether the axis-aligned box with the given corners lies outside, across or inside the
+// frustum. Boxes that are outside all planes but not entirely behind any one of them may be reported
+// as intersecting, so the result errs towards keeping boxes near the corners of the frustum.
+frustum_overlap_t frustum_classify_box(const frustum_t* f, vec3_t min, vec3_t max);
+
+#endif
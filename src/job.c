@@ -0,0 +1,351 @@
+// _GNU_SOURCE exposes the clock, CPU count and thread affinity functions under -std=c17.
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "job.h"
+#include "must.h"
+
+// Number of jobs each deque has space for before it first grows.
+#define JOB_DEQUE_INITIAL_CAPACITY 64
+
+// job_loop_t is a parallel loop, whose range of iterations is split between jobs.
+typedef struct job_loop_t {
+	job_for_fn fn;
+	void* ctx;
+	job_counter_t counter;
+} job_loop_t;
+
+// job_t is either a plain job or, if loop is set, a range of the iterations of a parallel loop.
+typedef struct job_t {
+	job_fn fn;
+	void* ctx;
+	job_loop_t* loop;
+	int start;
+	int end;
+	job_counter_t* counter;
+} job_t;
+
+// job_deque_t is a growable ring buffer of jobs. Its owner pushes and pops jobs at the bottom while
+// other threads steal them from the top. Jobs are coarse enough that a lock per deque costs little
+// next to them, and each lock is only contended by the owner and the occasional thief.
+typedef struct job_deque_t {
+	pthread_mutex_t mutex;
+	job_t* jobs;
+	int capacity; // a power of two
+	int top;
+	int bottom;
+} job_deque_t;
+
+typedef struct job_worker_t {
+	job_system_t* system;
+	int index;
+	pthread_t thread;
+	job_deque_t deque;
+	int depth; // number of jobs running on the thread, which nest while a job waits on a counter
+	unsigned steal_seed; // state of the generator choosing which deque to steal from first
+	atomic_llong busy_ns;
+	atomic_llong n_jobs;
+	atomic_llong n_stolen;
+} job_worker_t;
+
+// The worker whose deque the calling thread owns, or NULL for threads outside of the job system.
+static _Thread_local job_worker_t* t_worker = NULL;
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#ifdef __linux__
+static void pin_thread(pthread_t thread, int cpu) {
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	if (pthread_setaffinity_np(thread, sizeof(cpus), &cpus) != 0) {
+		fprintf(stderr, "failed to pin thread to CPU %d\n", cpu);
+	}
+}
+#else
+static void pin_thread(pthread_t thread, int cpu) {
+	// Affinity is left to the scheduler on platforms without pthread_setaffinity_np.
+	(void)thread;
+	(void)cpu;
+}
+#endif
+
+static void deque_init(job_deque_t* d) {
+	pthread_mutex_init(&d->mutex, NULL);
+	d->jobs = must_malloc(sizeof(job_t) * JOB_DEQUE_INITIAL_CAPACITY);
+	d->capacity = JOB_DEQUE_INITIAL_CAPACITY;
+	d->top = 0;
+	d->bottom = 0;
+}
+
+static void deque_push(job_deque_t* d, const job_t* job) {
+	pthread_mutex_lock(&d->mutex);
+	if (d->bottom - d->top == d->capacity) {
+		job_t* jobs = must_malloc(sizeof(job_t) * d->capacity * 2);
+		for (int i = 0; i < d->capacity; i++) {
+			jobs[i] = d->jobs[(d->top + i) & (d->capacity - 1)];
+		}
+		free(d->jobs);
+		d->jobs = jobs;
+		d->bottom -= d->top;
+		d->top = 0;
+		d->capacity *= 2;
+	}
+	d->jobs[d->bottom & (d->capacity - 1)] = *job;
+	d->bottom++;
+	pthread_mutex_unlock(&d->mutex);
+}
+
+// deque_take removes the newest job from the deque if from_top is unset, or the oldest if it is set,
+// returning false if the deque is empty.
+static bool deque_take(job_deque_t* d, bool from_top, job_t* job) {
+	pthread_mutex_lock(&d->mutex);
+	bool is_found = d->bottom > d->top;
+	if (is_found && from_top) {
+		*job = d->jobs[d->top & (d->capacity - 1)];
+		d->top++;
+	} else if (is_found) {
+		d->bottom--;
+		*job = d->jobs[d->bottom & (d->capacity - 1)];
+	}
+	if (d->bottom == d->top) {
+		d->bottom = 0;
+		d->top = 0;
+	}
+	pthread_mutex_unlock(&d->mutex);
+	return is_found;
+}
+
+static void deque_free(job_deque_t* d) {
+	pthread_mutex_destroy(&d->mutex);
+	free(d->jobs);
+}
+
+// take_job pops the worker's newest job, or failing that steals the oldest job of another worker,
+// starting from a random one so that thieves spread out.
+static bool take_job(job_system_t* system, job_worker_t* self, job_t* job) {
+	if (atomic_load(&system->n_queued) <= 0) {
+		return false;
+	}
+
+	bool is_found = deque_take(&self->deque, false, job);
+	if (!is_found) {
+		self->steal_seed ^= self->steal_seed << 13;
+		self->steal_seed ^= self->steal_seed >> 17;
+		self->steal_seed ^= self->steal_seed << 5;
+		int first = self->steal_seed % system->n_threads;
+		for (int i = 0; i < system->n_threads && !is_found; i++) {
+			job_worker_t* victim = &system->workers[(first + i) % system->n_threads];
+			if (victim != self && deque_take(&victim->deque, true, job)) {
+				atomic_fetch_add_explicit(&self->n_stolen, 1, memory_order_relaxed);
+				is_found = true;
+			}
+		}
+	}
+	if (is_found) {
+		atomic_fetch_sub(&system->n_queued, 1);
+	}
+	return is_found;
+}
+
+static void submit(job_system_t* system, const job_t* job) {
+	if (job->counter != NULL) {
+		atomic_fetch_add(&job->counter->n_pending, 1);
+	}
+	job_worker_t* self = t_worker != NULL ? t_worker : &system->workers[0];
+	deque_push(&self->deque, job);
+
+	// A worker about to sleep counts itself as sleeping before checking for queued jobs, so either
+	// it sees this job or it is woken here.
+	atomic_fetch_add(&system->n_queued, 1);
+	if (atomic_load(&system->n_sleeping) > 0) {
+		pthread_mutex_lock(&system->idle_mutex);
+		pthread_cond_signal(&system->work_available);
+		pthread_mutex_unlock(&system->idle_mutex);
+	}
+}
+
+// run_range splits off the upper half of the range as a new job until a single iteration remains,
+// which it runs, leaving the larger pieces at the top of the deque for other threads to steal.
+static void run_range(job_system_t* system, const job_t* job) {
+	job_loop_t* loop = job->loop;
+	int start = job->start;
+	int end = job->end;
+	while (end - start > 1) {
+		int mid = start + (end - start) / 2;
+		job_t upper = { .loop = loop, .start = mid, .end = end, .counter = &loop->counter };
+		submit(system, &upper);
+		end = mid;
+	}
+	loop->fn(loop->ctx, start);
+}
+
+static void run_job(job_worker_t* self, const job_t* job) {
+	long long start_ns = self->depth == 0 ? now_ns() : 0;
+	self->depth++;
+	if (job->loop != NULL) {
+		run_range(self->system, job);
+	} else {
+		job->fn(job->ctx);
+	}
+	self->depth--;
+	if (self->depth == 0) {
+		atomic_fetch_add_explicit(&self->busy_ns, now_ns() - start_ns, memory_order_relaxed);
+	}
+	atomic_fetch_add_explicit(&self->n_jobs, 1, memory_order_relaxed);
+
+	if (job->counter != NULL) {
+		atomic_fetch_sub(&job->counter->n_pending, 1);
+	}
+}
+
+static void* worker_main(void* arg) {
+	job_worker_t* self = arg;
+	job_system_t* system = self->system;
+	t_worker = self;
+	while (!atomic_load(&system->is_stopping)) {
+		job_t job;
+		if (take_job(system, self, &job)) {
+			run_job(self, &job);
+			continue;
+		}
+
+		pthread_mutex_lock(&system->idle_mutex);
+		atomic_fetch_add(&system->n_sleeping, 1);
+		while (atomic_load(&system->n_queued) <= 0 && !atomic_load(&system->is_stopping)) {
+			pthread_cond_wait(&system->work_available, &system->idle_mutex);
+		}
+		atomic_fetch_sub(&system->n_sleeping, 1);
+		pthread_mutex_unlock(&system->idle_mutex);
+	}
+	return NULL;
+}
+
+job_system_t* new_job_system(int n_threads, bool pin_threads) {
+	int n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_cpus < 1) {
+		n_cpus = 1;
+	}
+	if (n_threads <= 0) {
+		n_threads = n_cpus;
+	}
+
+	job_system_t* system = must_malloc(sizeof(job_system_t));
+	*system = (job_system_t){
+		.workers = must_malloc(sizeof(job_worker_t) * n_threads),
+		.n_threads = n_threads,
+		.report_start_ns = now_ns(),
+	};
+	atomic_init(&system->n_queued, 0);
+	atomic_init(&system->n_sleeping, 0);
+	atomic_init(&system->is_stopping, false);
+	pthread_mutex_init(&system->idle_mutex, NULL);
+	pthread_cond_init(&system->work_available, NULL);
+
+	for (int i = 0; i < n_threads; i++) {
+		job_worker_t* w = &system->workers[i];
+		w->system = system;
+		w->index = i;
+		w->depth = 0;
+		w->steal_seed = 2654435761u * (i + 1);
+		atomic_init(&w->busy_ns, 0);
+		atomic_init(&w->n_jobs, 0);
+		atomic_init(&w->n_stolen, 0);
+		deque_init(&w->deque);
+	}
+
+	// The calling thread is the first worker, and runs jobs only while it waits for them.
+	system->workers[0].thread = pthread_self();
+	t_worker = &system->workers[0];
+	for (int i = 1; i < n_threads; i++) {
+		if (pthread_create(&system->workers[i].thread, NULL, worker_main, &system->workers[i]) != 0) {
+			fprintf(stderr, "failed to start job thread %d\n", i);
+			abort();
+		}
+	}
+	if (pin_threads) {
+		for (int i = 0; i < n_threads; i++) {
+			pin_thread(system->workers[i].thread, i % n_cpus);
+		}
+	}
+	return system;
+}
+
+void job_run(job_system_t* system, job_fn fn, void* ctx, job_counter_t* counter) {
+	job_t job = { .fn = fn, .ctx = ctx, .counter = counter };
+	submit(system, &job);
+}
+
+void job_wait(job_system_t* system, job_counter_t* counter) {
+	job_worker_t* self = t_worker != NULL ? t_worker : &system->workers[0];
+	while (atomic_load(&counter->n_pending) > 0) {
+		job_t job;
+		if (take_job(system, self, &job)) {
+			run_job(self, &job);
+		} else {
+			// The remaining jobs are running on other threads.
+			sched_yield();
+		}
+	}
+}
+
+void job_parallel_for(job_system_t* system, int n, job_for_fn fn, void* ctx) {
+	if (n <= 0) {
+		return;
+	}
+
+	job_loop_t loop = { .fn = fn, .ctx = ctx };
+	atomic_init(&loop.counter.n_pending, 1);
+	job_t root = { .loop = &loop, .start = 0, .end = n, .counter = &loop.counter };
+	job_worker_t* self = t_worker != NULL ? t_worker : &system->workers[0];
+	run_job(self, &root);
+	job_wait(system, &loop.counter);
+}
+
+void job_system_report(job_system_t* system, FILE* stream) {
+	long long now = now_ns();
+	double elapsed_ns = now - system->report_start_ns;
+	system->report_start_ns = now;
+	for (int i = 0; i < system->n_threads; i++) {
+		job_worker_t* w = &system->workers[i];
+		long long busy_ns = atomic_exchange_explicit(&w->busy_ns, 0, memory_order_relaxed);
+		long long n_jobs = atomic_exchange_explicit(&w->n_jobs, 0, memory_order_relaxed);
+		long long n_stolen = atomic_exchange_explicit(&w->n_stolen, 0, memory_order_relaxed);
+		fprintf(
+			stream,
+			"job thread %d: %5.1f%% busy, %lld jobs, %lld stolen\n",
+			i,
+			elapsed_ns > 0 ? 100 * busy_ns / elapsed_ns : 0,
+			n_jobs,
+			n_stolen
+		);
+	}
+}
+
+void job_system_free(job_system_t* system) {
+	pthread_mutex_lock(&system->idle_mutex);
+	atomic_store(&system->is_stopping, true);
+	pthread_cond_broadcast(&system->work_available);
+	pthread_mutex_unlock(&system->idle_mutex);
+	for (int i = 1; i < system->n_threads; i++) {
+		pthread_join(system->workers[i].thread, NULL);
+	}
+
+	for (int i = 0; i < system->n_threads; i++) {
+		deque_free(&system->workers[i].deque);
+	}
+	if (t_worker != NULL && t_worker->system == system) {
+		t_worker = NULL;
+	}
+	pthread_cond_destroy(&system->work_available);
+	pthread_mutex_destroy(&system->idle_mutex);
+	free(system->workers);
+	free(system);
+}
@@ -0,0 +1,68 @@
+// job.h provides a work-stealing job system, which runs small units of work submitted from any stage
+// of the engine on a fixed set of threads.
+#ifndef JOB_H
+#define JOB_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+Structs
+*/
+
+// job_fn performs a job, passed the context it was submitted with.
+typedef void (*job_fn)(void* ctx);
+
+// job_for_fn performs the iteration at index i of a parallel loop, passed the loop's context.
+typedef void (*job_for_fn)(void* ctx, int i);
+
+// job_counter_t counts the unfinished jobs submitted against it, letting a thread wait for a group of
+// jobs to finish. A zero-initialized counter has no jobs.
+typedef struct job_counter_t {
+	atomic_int n_pending;
+} job_counter_t;
+
+// job_system_t owns the threads that run jobs. Each thread queues the jobs it submits in its own deque
+// and takes them back newest first, stealing the oldest jobs from other threads' deques once its own
+// is empty. The thread that creates the system is the first of its threads, and runs jobs whenever it
+// waits on a counter.
+typedef struct job_system_t {
+	struct job_worker_t* workers;
+	int n_threads;
+	atomic_int n_queued; // number of jobs waiting in any deque
+	atomic_int n_sleeping; // number of workers asleep waiting for jobs
+	atomic_bool is_stopping;
+	pthread_mutex_t idle_mutex;
+	pthread_cond_t work_available;
+	long long report_start_ns; // start of the period covered by the next utilization report
+} job_system_t;
+
+/*
+Functions
+*/
+
+// Construct a job system that runs jobs on n_threads threads, including the caller's, or on one
+// thread per CPU if n_threads is 0. If pin_threads is set, each thread is bound to its own CPU where
+// the platform allows it. Aborts if the threads can't be started.
+job_system_t* new_job_system(int n_threads, bool pin_threads);
+
+// Queue fn to run on some thread of the system, counting it against counter, which may be NULL.
+void job_run(job_system_t* system, job_fn fn, void* ctx, job_counter_t* counter);
+
+// Run queued jobs on the calling thread until every job counted against counter has finished.
+void job_wait(job_system_t* system, job_counter_t* counter);
+
+// Calls fn for each i in [0, n), spread across the system's threads, and returns once every call has
+// finished. The range is split in halves, so that idle threads steal large pieces of it.
+void job_parallel_for(job_system_t* system, int n, job_for_fn fn, void* ctx);
+
+// Write the share of time each thread spent running jobs since the last report, along with the number
+// of jobs it ran and stole, to the stream.
+void job_system_report(job_system_t* system, FILE* stream);
+
+// Stop the system's threads and free the memory associated with the system.
+void job_system_free(job_system_t* system);
+
+#endif
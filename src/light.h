@@ -5,7 +5,7 @@
 
 // light_t represents an ambient light source with direction only.
 typedef struct light_t {
-	vec3_t direction;
+	vec3_t direction; // points from the scene towards the light, in world space
 } light_t;
 
 #endif
\ No newline at end of file
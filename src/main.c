@@ -2,25 +2,122 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <SDL2/SDL.h>
-#include <time.h>
 
+#include "arena.h"
 #include "array.h"
+#include "bsp.h"
 #include "display.h"
+#include "frustum.h"
+#include "job.h"
 #include "mesh.h"
 #include "must.h"
+#include "resident.h"
+#include "scene.h"
+#include "sort.h"
 #include "texture.h"
 #include "triangle.h"
-#include "upng.h"
 #include "vector.h"
+#include "vertex.h"
+
+/*
+Structs
+*/
+
+// triangle_list_t holds the triangles to render, along with a depth key for each if they are to be
+// depth sorted and a texture mapping for each if they are to be textured, in memory drawn from the
+// frame arena. Each array is indexed like the triangles.
+typedef struct triangle_list_t {
+	packed_triangle_t* triangles;
+	depth_key_t* depth_keys;
+	triangle_uv_t* uvs;
+	bool is_textured;
+	int len;
+	int capacity;
+} triangle_list_t;
+
+// geometry_job_t describes the geometry stage of one mesh instance, whose items, either clusters or
+// faces, are split into contiguous ranges processed by separate tasks. Each task writes the triangles
+// of its range to the triangle list from its own offset, which leaves room for every face in the
+// range, so the tasks never share memory.
+typedef struct geometry_job_t {
+	const mesh_t* mesh;
+	const texture_t* texture;
+	mat4_t clip_matrix; // maps model space to clip space
+	mat4_t vertex_matrix; // maps the mesh's stored positions to clip space, dequantizing them
+	vec3_t eye;
+	vec3_t light_direction;
+	const int* items;
+	int n_items;
+	const bool* cluster_is_visible; // visibility of each cluster, if the items are faces
+	int n_tasks;
+	int* task_offsets; // index in the triangle list of each task's first triangle
+	int* task_lens; // number of triangles each task wrote
+} geometry_job_t;
 
 // Global variables for execution status and game loop.
 bool g_is_running = false;
 Uint64 g_prev_frame_time = 0;
-triangle_t* g_triangles_to_render = NULL; // dynamic array of triangles to render
+arena_t g_frame_arena = { 0 }; // memory for data that lives no longer than the current frame
+triangle_list_t g_triangles_to_render = { 0 };
+bool g_triangles_need_depth_sort = true; // false if the triangles to render are already in order
+vertex_cache_t g_vertex_cache = { 0 };
+job_system_t* g_jobs = NULL;
+scene_loads_t g_scene_loads = { 0 }; // assets being loaded before the first frame
+resident_set_t* g_resident_set = NULL; // levels of streamed meshes held in memory
+
+// Size in bytes of the frame arena's first block, which grows to fit the busiest frame.
+const size_t FRAME_ARENA_SIZE = 1 << 20;
+
+// Number of threads that run jobs, including the main thread, or 0 for one per CPU.
+const int JOB_THREADS = 0;
+
+// If set, each thread that runs jobs is bound to its own CPU.
+const bool JOB_PIN_THREADS = false;
+
+// Size in bytes of the levels of streamed meshes kept in memory, beyond which the least recently used
+// are evicted.
+const size_t RESIDENT_SET_BUDGET = (size_t)256 << 20;
+
+// Size in bytes of the smallest .obj file that is streamed rather than loaded whole.
+const long long STREAMED_MESH_MIN_FILE_SIZE = 256LL << 20;
+
+// Fewest faces worth handing to a task of the geometry stage, below which the cost of waking a
+// worker outweighs the work it would share.
+const int GEOMETRY_MIN_FACES_PER_TASK = 1024;
+
+// Projected area in pixels per face that levels of detail are chosen to approach. Roughly half the
+// faces of a closed mesh face the camera, so each visible face covers about twice this area.
+const float LOD_PIXELS_PER_FACE = 2;
+
+// Adds a node drawing the mesh in the .obj file at path with the texture. Meshes too large to load
+// whole are streamed, and drawn a chunk at a time as they arrive. The rest are queued to be loaded
+// with the scene's other assets, along with their levels of detail and with quantized vertices.
+void add_mesh_node(const char* path, const texture_t* texture) {
+	struct stat st;
+	if (stat(path, &st) == 0 && st.st_size >= STREAMED_MESH_MIN_FILE_SIZE) {
+		scene_add_streamed_node(&g_scene, -1, resident_set_add(g_resident_set, path), texture);
+		return;
+	}
+	const mesh_t* mesh = scene_load_mesh(&g_scene, &g_scene_loads, path, true, true);
+	scene_add_node(&g_scene, -1, mesh, texture);
+}
+
+// Queues the scene's assets to be loaded on the job system and adds the nodes that refer to them.
+// Loading begins before the window is created, so that the two overlap, and setup waits for it to
+// finish before the first frame. Streamed meshes are loaded on the resident set's own thread, and
+// aren't waited for.
+void load_scene(void) {
+	g_jobs = new_job_system(JOB_THREADS, JOB_PIN_THREADS);
+	g_scene_loads = new_scene_loads(g_jobs);
+	g_resident_set = new_resident_set(RESIDENT_SET_BUDGET);
+	const texture_t* texture = scene_load_texture(&g_scene, &g_scene_loads, "assets/f22.png");
+	add_mesh_node("assets/f22.obj", texture);
+}
 
 int setup(void) {
-	srand(time(0)); // seed the random number generator (used for sorting)
 	g_color_buffer = must_malloc(sizeof(color_t) * g_window_width * g_window_height);
 	g_color_buffer_texture = SDL_CreateTexture(
 		g_renderer,
@@ -30,9 +127,13 @@ int setup(void) {
 		g_window_height
 	);
 	g_projection_matrix = mat4_make_perspective(fov_rads, g_window_height / (float)g_window_width, 0.1, 100.0);
+	g_frame_arena = new_arena(FRAME_ARENA_SIZE);
 
-	load_png_texture("assets/f22.png");
-	return load_mesh("assets/f22.obj");
+	int err = scene_wait_loads(&g_scene_loads);
+	if (err) {
+		return -1;
+	}
+	return 0;
 }
 
 void process_keydown(SDL_KeyCode key) {
@@ -64,6 +165,9 @@ void process_keydown(SDL_KeyCode key) {
 	case SDLK_c:
 		g_enable_back_face_culling = !g_enable_back_face_culling;
 		break;
+	case SDLK_j:
+		job_system_report(g_jobs, stdout);
+		break;
 	default:
 		// Do nothing.
 		break;
@@ -93,65 +197,451 @@ void await_frame(void) {
 	g_prev_frame_time = SDL_GetTicks64();
 }
 
-// Modify mesh position fields as desired to view the model in motion.
-void update_mesh(void) {
-	g_mesh.rotation.x += 0.05;
-	g_mesh.rotation.y += 0.05;
-	g_mesh.rotation.z += 0.05;
-	// g_mesh.scale.x += 0.002;
-	// g_mesh.scale.y += 0.001;
-	// g_mesh.translation.x += 0.01;
-	g_mesh.translation.z = 10.0;
+// Modify node position fields as desired to view the models in motion. Nodes that are left alone
+// cost nothing to update.
+void update_scene(void) {
+	int n_nodes = array_len(g_scene.nodes);
+	for (int i = 0; i < n_nodes; i++) {
+		const scene_node_t* node = &g_scene.nodes[i];
+		if (node->parent >= 0) {
+			continue;
+		}
+
+		vec3_t rotation = node->rotation;
+		rotation.x += 0.05;
+		rotation.y += 0.05;
+		rotation.z += 0.05;
+		scene_set_rotation(&g_scene, i, rotation);
+		// scene_set_scale(&g_scene, i, (vec3_t){ node->scale.x + 0.002, node->scale.y + 0.001, node->scale.z });
+		vec3_t translation = node->translation;
+		// translation.x += 0.01;
+		translation.z = 10.0;
+		scene_set_translation(&g_scene, i, translation);
+	}
+	scene_update_transforms(&g_scene);
 }
 
-// Create a new set of triangles to render based on the latest position of the mesh.
-void update(void) {
-	await_frame();
-	array_reset(g_triangles_to_render, sizeof(triangle_t));
+// Returns the area in pixels that the box from min to max in the node's space covers on screen,
+// estimated from a sphere around it, or INFINITY if the camera is within the sphere.
+float projected_area(const scene_node_t* node, vec3_t min, vec3_t max) {
+	vec3_t center = {
+		(min.x + max.x) / 2,
+		(min.y + max.y) / 2,
+		(min.z + max.z) / 2,
+	};
+	vec3_t half_size = vec3_sub(&max, &center);
+	float scale = 0;
+	for (int c = 0; c < 3; c++) {
+		vec3_t axis = { node->world.m[0][c], node->world.m[1][c], node->world.m[2][c] };
+		scale = fmaxf(scale, vec3_magnitude(&axis));
+	}
+	float radius = vec3_magnitude(&half_size) * scale;
+
+	// The camera looks along the z axis, so the depth of the center is its distance along z.
+	vec3_t world_center = vec3_transform(&center, &node->world);
+	float depth = world_center.z - g_camera_position.z;
+	if (depth <= radius) {
+		return INFINITY;
+	}
+	float projected_radius = radius * g_projection_matrix.m[1][1] * (g_window_height / 2.0) / depth;
+	return M_PI * projected_radius * projected_radius;
+}
+
+// Returns the level of detail of the node's mesh whose faces project to about LOD_PIXELS_PER_FACE
+// pixels each, estimating the projected area of the mesh from its bounding box.
+const mesh_t* select_lod(const scene_node_t* node) {
+	const mesh_t* mesh = node->mesh;
+	if (mesh->coarser == NULL || mesh->bvh.root < 0) {
+		return mesh;
+	}
+
+	const bvh_node_t* bounds = &mesh->bvh.nodes[mesh->bvh.root];
+	float area = projected_area(node, bounds->min, bounds->max);
+	if (isinf(area)) {
+		return mesh;
+	}
+	return mesh_select_lod(mesh, area / LOD_PIXELS_PER_FACE);
+}
+
+// Returns the index of the level of detail of the chunk of the node's streamed mesh whose faces
+// project to about LOD_PIXELS_PER_FACE pixels each, as select_lod does for whole meshes.
+int select_chunk_lod(const scene_node_t* node, const resident_chunk_t* chunk) {
+	float area = projected_area(node, chunk->min, chunk->max);
+	if (isinf(area)) {
+		return 0;
+	}
+	int level = 0;
+	while (level + 1 < chunk->n_levels && chunk->levels[level].n_faces > area / LOD_PIXELS_PER_FACE) {
+		level++;
+	}
+	return level;
+}
+
+// Finds the clusters of the mesh's faces that may be visible, rejecting those that lie outside the
+// view frustum or, if back-face culling is enabled, that face away from the eye. Both are given in
+// model space. Writes the clusters to visible, which must have space for every cluster, and returns
+// their number.
+int update_visible_clusters(const mesh_t* mesh, const frustum_t* frustum, vec3_t eye, int* visible) {
+	int n_visible = bvh_cull(&mesh->bvh, mesh, frustum, visible);
+	if (!g_enable_back_face_culling) {
+		return n_visible;
+	}
+
+	int n_front_facing = 0;
+	for (int i = 0; i < n_visible; i++) {
+		int cluster_index = visible[i];
+		if (!cluster_is_backfacing(&mesh->clusters[cluster_index], eye)) {
+			visible[n_front_facing++] = cluster_index;
+		}
+	}
+	return n_front_facing;
+}
+
+// Ensures the triangle list has space for n more triangles.
+void triangle_list_reserve(triangle_list_t* list, int n) {
+	if (list->len + n <= list->capacity) {
+		return;
+	}
+
+	int capacity = list->capacity * 2 > list->len + n ? list->capacity * 2 : list->len + n;
+	list->triangles = arena_grow(
+		&g_frame_arena,
+		list->triangles,
+		sizeof(packed_triangle_t) * list->len,
+		sizeof(packed_triangle_t) * capacity
+	);
+	list->depth_keys = arena_grow(
+		&g_frame_arena,
+		list->depth_keys,
+		sizeof(depth_key_t) * list->len,
+		sizeof(depth_key_t) * capacity
+	);
+	if (list->is_textured) {
+		list->uvs = arena_grow(
+			&g_frame_arena,
+			list->uvs,
+			sizeof(triangle_uv_t) * list->len,
+			sizeof(triangle_uv_t) * capacity
+		);
+	}
+	list->capacity = capacity;
+}
 
-	update_mesh();
-	mat4_t world_matrix = mesh_to_world_matrix(&g_mesh);
+// Returns the number of tasks to split the geometry stage of n_faces faces into.
+int geometry_task_count(int n_faces) {
+	int n_tasks = (n_faces + GEOMETRY_MIN_FACES_PER_TASK - 1) / GEOMETRY_MIN_FACES_PER_TASK;
+	return n_tasks < g_jobs->n_threads ? n_tasks : g_jobs->n_threads;
+}
 
-	int n_mesh_faces = array_len(g_mesh.faces);
-	for (int i = 0; i < n_mesh_faces; i++) {
-		face_t face = new_face_from_mesh_face(&g_mesh.faces[i]);
-		face_transform(&face, &world_matrix);
-		if (g_enable_back_face_culling && face_should_cull(&face, g_camera_position)) {
+// Returns the first item of the task's range of the job's items, or the end of the items when task
+// is n_tasks.
+int geometry_task_start(const geometry_job_t* job, int task) {
+	return (long long)job->n_items * task / job->n_tasks;
+}
+
+// Transforms and projects the vertices of the task's range of visible clusters into the shared vertex
+// cache. Clusters own disjoint ranges of vertices, so tasks never write to the same vertex.
+void update_vertices_task(void* ctx, int task) {
+	const geometry_job_t* job = ctx;
+	int start = geometry_task_start(job, task);
+	int end = geometry_task_start(job, task + 1);
+	vertex_cache_update(
+		&g_vertex_cache,
+		job->mesh,
+		job->items + start,
+		end - start,
+		&job->vertex_matrix,
+		g_window_width,
+		g_window_height
+	);
+}
+
+// Culls and lights the face at the given index of the job's mesh, writing it to index i of the
+// triangles to render if it is visible. Returns true if the face was written.
+bool update_face(const geometry_job_t* job, int face_index, int i) {
+	const mesh_t* mesh = job->mesh;
+	face_t face = new_face_from_mesh_face(mesh, face_index);
+	if (g_enable_back_face_culling && face_should_cull(&face, job->eye)) {
+		return false;
+	}
+
+	face_illuminate(&face, job->light_direction);
+	const mesh_face_t* mf = &mesh->faces[face_index];
+	triangle_list_t* list = &g_triangles_to_render;
+	list->triangles[i] = new_packed_triangle(&face, mf, &g_vertex_cache);
+	if (list->is_textured) {
+		list->uvs[i] = new_triangle_uv(mesh, mf, job->texture);
+	}
+	if (g_triangles_need_depth_sort) {
+		list->depth_keys[i] = new_depth_key(triangle_depth(mf, &g_vertex_cache), i);
+	}
+	return true;
+}
+
+// Writes the visible faces of the task's range of visible clusters to the triangles to render.
+void update_cluster_faces_task(void* ctx, int task) {
+	geometry_job_t* job = ctx;
+	int offset = job->task_offsets[task];
+	int len = 0;
+	int end = geometry_task_start(job, task + 1);
+	for (int i = geometry_task_start(job, task); i < end; i++) {
+		const cluster_t* c = &job->mesh->clusters[job->items[i]];
+		for (int j = 0; j < c->n_faces; j++) {
+			len += update_face(job, c->first_face + j, offset + len);
+		}
+	}
+	job->task_lens[task] = len;
+}
+
+// Writes the visible faces of the task's range of faces, which are in back-to-front order, to the
+// triangles to render.
+void update_ordered_faces_task(void* ctx, int task) {
+	geometry_job_t* job = ctx;
+	int offset = job->task_offsets[task];
+	int len = 0;
+	int end = geometry_task_start(job, task + 1);
+	for (int i = geometry_task_start(job, task); i < end; i++) {
+		int face_index = job->items[i];
+		if (job->cluster_is_visible[job->mesh->face_clusters[face_index]]) {
+			len += update_face(job, face_index, offset + len);
+		}
+	}
+	job->task_lens[task] = len;
+}
+// Reserves space in the triangles to render for each of the job's tasks to write a triangle for every
+// face in its range.
+void begin_geometry_tasks(geometry_job_t* job) {
+	job->task_offsets = arena_alloc(&g_frame_arena, sizeof(int) * job->n_tasks);
+	job->task_lens = arena_alloc(&g_frame_arena, sizeof(int) * job->n_tasks);
+	int n_faces = 0;
+	for (int task = 0; task < job->n_tasks; task++) {
+		job->task_offsets[task] = g_triangles_to_render.len + n_faces;
+		int start = geometry_task_start(job, task);
+		int end = geometry_task_start(job, task + 1);
+		if (job->cluster_is_visible != NULL) {
+			n_faces += end - start;
 			continue;
 		}
+		for (int i = start; i < end; i++) {
+			n_faces += job->mesh->clusters[job->items[i]].n_faces;
+		}
+	}
+	triangle_list_reserve(&g_triangles_to_render, n_faces);
+}
 
-		face_illuminate(&face, &g_light);
-		triangle_t triangle = new_triangle_from_face(&face, &g_projection_matrix);
-		triangle_position_on_screen(&triangle, g_window_width, g_window_height);
-		array_push(g_triangles_to_render, triangle);
+// Closes the gaps left after the triangles written by each of the job's tasks, so that the triangles
+// to render keep the order in which the tasks' ranges were given. The first task's triangles are
+// already in place, so a job of one task moves nothing.
+void end_geometry_tasks(const geometry_job_t* job) {
+	triangle_list_t* list = &g_triangles_to_render;
+	for (int i = 0; i < job->n_tasks; i++) {
+		int offset = job->task_offsets[i];
+		int len = job->task_lens[i];
+		if (offset != list->len) {
+			memmove(&list->triangles[list->len], &list->triangles[offset], sizeof(packed_triangle_t) * len);
+			if (list->is_textured) {
+				memmove(&list->uvs[list->len], &list->uvs[offset], sizeof(triangle_uv_t) * len);
+			}
+			for (int j = 0; g_triangles_need_depth_sort && j < len; j++) {
+				depth_key_t key = list->depth_keys[offset + j];
+				key.index = list->len + j;
+				list->depth_keys[list->len + j] = key;
+			}
+		}
+		list->len += len;
 	}
 }
 
+// Returns a geometry job for the node's instance, whose frustum is written to frustum. Culling,
+// lighting and face ordering all happen in model space, where face normals are fixed, so the camera,
+// light and view frustum are transformed into model space once per instance instead.
+geometry_job_t new_geometry_job(const scene_node_t* instance, frustum_t* frustum) {
+	geometry_job_t job = {
+		.texture = instance->texture,
+		.clip_matrix = mat4_mul(&g_projection_matrix, &instance->world),
+	};
+	const mat4_t* model_matrix = &instance->inverse_world;
+	job.eye = vec3_transform(&g_camera_position, model_matrix);
+	vec4_t light_direction = { g_light.direction.x, g_light.direction.y, g_light.direction.z, 0 };
+	light_direction = mat4_mul_vec4(model_matrix, &light_direction);
+	job.light_direction = vec3_from_vec4(&light_direction);
+	job.light_direction = vec3_normalize(&job.light_direction);
+	*frustum = frustum_from_matrix(&job.clip_matrix);
+	return job;
+}
+
+// Queues the visible triangles of the mesh, which the job's instance draws, to be rendered. Every
+// mesh shares the vertex cache, which is safe because triangles copy their projected vertices out of
+// it. The vertex and face stages are each split across the job system, and everything else the mesh
+// needs for the frame is drawn from the frame arena.
+void update_mesh(geometry_job_t job, const mesh_t* mesh, const frustum_t* frustum) {
+	job.mesh = mesh;
+	mat4_t dequantize_matrix = mesh_dequantize_matrix(mesh);
+	job.vertex_matrix = mat4_mul(&job.clip_matrix, &dequantize_matrix);
+	int n_clusters = array_len(mesh->clusters);
+	int* visible_clusters = arena_alloc(&g_frame_arena, sizeof(int) * n_clusters);
+	int n_visible = update_visible_clusters(mesh, frustum, job.eye, visible_clusters);
+
+	// Only the vertices of visible clusters are transformed, so the cost of both the vertex and face
+	// stages scales with what is on screen rather than with the size of the mesh.
+	int n_visible_faces = 0;
+	for (int i = 0; i < n_visible; i++) {
+		n_visible_faces += mesh->clusters[visible_clusters[i]].n_faces;
+	}
+	job.items = visible_clusters;
+	job.n_items = n_visible;
+	job.n_tasks = geometry_task_count(n_visible_faces);
+	// The cache is grown here, since the tasks share it.
+	vertex_cache_hold(&g_vertex_cache, mesh->positions.len);
+	job_parallel_for(g_jobs, job.n_tasks, update_vertices_task, &job);
+
+	if (!g_triangles_need_depth_sort && bsp_is_built(&mesh->bsp)) {
+		bool* cluster_is_visible = arena_alloc(&g_frame_arena, sizeof(bool) * n_clusters);
+		memset(cluster_is_visible, 0, sizeof(bool) * n_clusters);
+		for (int i = 0; i < n_visible; i++) {
+			cluster_is_visible[visible_clusters[i]] = true;
+		}
+
+		// The faces are split into ranges of the back-to-front order, which the triangles to render
+		// keep.
+		int* face_order = arena_alloc(&g_frame_arena, sizeof(int) * array_len(mesh->bsp.faces));
+		job.items = face_order;
+		job.n_items = bsp_back_to_front(&mesh->bsp, job.eye, face_order);
+		job.cluster_is_visible = cluster_is_visible;
+		job.n_tasks = geometry_task_count(job.n_items);
+		begin_geometry_tasks(&job);
+		job_parallel_for(g_jobs, job.n_tasks, update_ordered_faces_task, &job);
+	} else {
+		begin_geometry_tasks(&job);
+		job_parallel_for(g_jobs, job.n_tasks, update_cluster_faces_task, &job);
+	}
+	end_geometry_tasks(&job);
+}
+
+// Queues the visible triangles of the node's mesh to be rendered, at the level of detail suited to its
+// size on screen.
+void update_instance(const scene_node_t* instance) {
+	frustum_t frustum;
+	geometry_job_t job = new_geometry_job(instance, &frustum);
+	update_mesh(job, select_lod(instance), &frustum);
+}
+
+// Queues the visible triangles of the node's streamed mesh to be rendered, a chunk at a time. Each
+// chunk in view is drawn at the level of detail suited to its own size on screen or, while that level
+// is loading, at the nearest level that is resident, so the mesh is refined as levels arrive. The
+// coarsest levels of the chunks in view are requested before any other, so that the budget is spent
+// on covering the view before refining it. Chunks with no level resident yet are left out.
+void update_streamed_instance(const scene_node_t* instance) {
+	frustum_t frustum;
+	geometry_job_t job = new_geometry_job(instance, &frustum);
+	resident_mesh_t* streamed = instance->streamed_mesh;
+	int n_chunks = resident_mesh_n_chunks(streamed);
+	int* visible_chunks = arena_alloc(&g_frame_arena, sizeof(int) * (n_chunks > 0 ? n_chunks : 1));
+	int n_visible = 0;
+	for (int i = 0; i < n_chunks; i++) {
+		const resident_chunk_t* chunk = &streamed->chunks[i];
+		if (frustum_classify_box(&frustum, chunk->min, chunk->max) != FRUSTUM_OUTSIDE) {
+			visible_chunks[n_visible++] = i;
+			resident_set_request(g_resident_set, streamed, i, chunk->n_levels - 1);
+		}
+	}
+
+	for (int i = 0; i < n_visible; i++) {
+		int chunk = visible_chunks[i];
+		int level = select_chunk_lod(instance, &streamed->chunks[chunk]);
+		const mesh_t* mesh = resident_set_request(g_resident_set, streamed, chunk, level);
+		if (mesh != NULL) {
+			update_mesh(job, mesh, &frustum);
+		}
+	}
+}
+
+// Returns true if the triangles of the scene must be depth sorted to be drawn in painter's order.
+// Back-face culling alone resolves the visibility of convex meshes, so their triangles may be drawn
+// in any order, while meshes with a BSP tree visit their faces back to front from the camera's
+// position. Neither orders the faces of one instance against another, so scenes of several
+// instances are always sorted, and nor are the chunks of a streamed mesh.
+bool scene_needs_depth_sort(void) {
+	if (g_scene.n_instances != 1) {
+		return true;
+	}
+
+	const scene_node_t* instance = g_scene.nodes;
+	while (instance->mesh == NULL && instance->streamed_mesh == NULL) {
+		instance++;
+	}
+	if (instance->streamed_mesh != NULL) {
+		return true;
+	}
+	const mesh_t* mesh = select_lod(instance);
+	return !(mesh->is_convex && g_enable_back_face_culling) && !bsp_is_built(&mesh->bsp);
+}
+
+// Create a new set of triangles to render based on the latest positions of the scene's nodes. The
+// triangles of every mesh instance are gathered into a single list, so that they are ordered and
+// rasterized together.
+void update(void) {
+	await_frame();
+	// Space is reserved up front for as many triangles as the last frame rendered, which is usually
+	// close to the number this frame will.
+	int expected_len = g_triangles_to_render.len;
+	g_triangles_to_render = (triangle_list_t){ .is_textured = render_mode_is_textured() };
+	triangle_list_reserve(&g_triangles_to_render, expected_len);
+
+	update_scene();
+	g_triangles_need_depth_sort = scene_needs_depth_sort();
+	int n_nodes = array_len(g_scene.nodes);
+	for (int i = 0; i < n_nodes; i++) {
+		if (g_scene.nodes[i].mesh != NULL) {
+			update_instance(&g_scene.nodes[i]);
+		} else if (g_scene.nodes[i].streamed_mesh != NULL) {
+			update_streamed_instance(&g_scene.nodes[i]);
+		}
+	}
+}
+
+// Sort the compact depth keys rather than the triangles themselves, then render the triangles in
+// the order of their keys.
 void render_triangles_to_color_buffer(void) {
-	int len = array_len(g_triangles_to_render);
-	quick_sort(g_triangles_to_render, len, sizeof(triangle_t), triangle_less_depth);
-	for (int i = len - 1; i >= 0; i--) {
-		render_triangle(&g_triangles_to_render[i]);
+	const triangle_list_t* list = &g_triangles_to_render;
+	if (!g_triangles_need_depth_sort) {
+		for (int i = 0; i < list->len; i++) {
+			render_triangle(&list->triangles[i], list->is_textured ? &list->uvs[i] : NULL);
+		}
+		return;
+	}
+
+	depth_key_t* scratch = arena_alloc(&g_frame_arena, sizeof(depth_key_t) * list->len);
+	const depth_key_t* sorted = radix_sort_depth_keys(list->depth_keys, scratch, list->len);
+	for (int i = list->len - 1; i >= 0; i--) {
+		int index = sorted[i].index;
+		render_triangle(&list->triangles[index], list->is_textured ? &list->uvs[index] : NULL);
 	}
 }
 
 // Render triangles using the painter's algorithm, starting with the deepest triangles and painting
-// over them with shallower ones.
+// over them with shallower ones. Everything allocated for the frame is released once it is drawn, and
+// the levels of streamed meshes it used may then be evicted.
 void render(void) {
 	render_triangles_to_color_buffer();
 	render_color_buffer();
 	clear_color_buffer(BLACK);
 	SDL_RenderPresent(g_renderer);
+	arena_reset(&g_frame_arena);
+	resident_set_end_frame(g_resident_set);
 }
 
 void free_resources(void) {
-	array_free(g_mesh.faces);
-	array_free(g_mesh.vertices);
-	upng_free(png_texture);
+	resident_set_free(g_resident_set);
+	job_system_free(g_jobs);
+	scene_free(&g_scene);
+	vertex_cache_free(&g_vertex_cache);
+	arena_free(&g_frame_arena);
 	free(g_color_buffer);
 }
 
 int main(void) {
+	load_scene();
 	g_is_running = initialize_window();
 
 	int err = setup();
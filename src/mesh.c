@@ -1,140 +1,428 @@
+#include "cache.h"
+#include "edge.h"
 #include "mesh.h"
+#include "obj.h"
+#include "simplify.h"
 
-mesh_t g_mesh = {
-	.vertices = NULL,
-	.faces = NULL,
-	.tex_coords = NULL,
-	.rotation = { 0, 0, 0 },
-	.scale = { 1.0, 1.0, 1.0 },
-	.translation = { 0, 0, 0 },
-};
-
-const int MAX_LINE = 512;
-
-// new_mesh_face constructs a mesh_face with a reference to the vertex array of the larger mesh for
-// convenience when looking up its vertices.
-mesh_face_t new_mesh_face(const vec3_t* mesh_vertices, const tex2_t* mesh_tex_coords) {
-	return (mesh_face_t){
-		.mesh_vertices = mesh_vertices,
-		.mesh_tex_coords = mesh_tex_coords,
-		.color = DEFAULT_FILL_COLOR
+// Meshes with more faces than this are depth sorted each frame instead of being ordered by a BSP
+// tree, since splitting inflates large curved meshes and their trees take seconds to build.
+const int BSP_MAX_FACES = 65536;
+
+// Distance in front of a face, relative to the size of the mesh, within which a neighbouring vertex
+// is considered to be coplanar when testing for convexity.
+const float CONVEX_EPSILON = 1e-5;
+
+// Levels of detail are only built while they would have at least this many faces, below which the
+// cost of a mesh is dominated by its per-instance overhead.
+const int LOD_MIN_FACES = 256;
+
+// Simplification stops once a level would not have this fraction fewer faces than the last, since
+// the remaining edges cannot be collapsed without damaging the surface.
+const float LOD_MIN_REDUCTION = 0.1;
+
+// Largest quantized value of a position or tex coord component, which represents the top of its range.
+const int QUANTIZED_MAX = 65535;
+
+mesh_t new_mesh(void) {
+	return (mesh_t){
+		.vertices = NULL,
+		.positions = { .x = NULL, .y = NULL, .z = NULL, .qx = NULL, .qy = NULL, .qz = NULL, .len = 0 },
+		.faces = NULL,
+		.face_uvs = NULL,
+		.normals = NULL,
+		.tex_coords = NULL,
+		.quantized_tex_coords = NULL,
+		.clusters = NULL,
+		.face_clusters = NULL,
+		.bvh = { .nodes = NULL, .clusters = NULL, .root = -1 },
+		.bsp = { .nodes = NULL, .faces = NULL, .root = -1 },
+		.is_convex = false,
+		.is_quantized = false,
+		.quantization = {
+			.position_scale = { 0, 0, 0 },
+			.position_bias = { 0, 0, 0 },
+			.uv_scale = { 0, 0 },
+			.uv_bias = { 0, 0 },
+		},
+		.coarser = NULL,
+		.is_cached = false,
+		.cache = { .data = NULL, .size = 0 },
 	};
 }
 
-vec3_t mesh_face_vertex_a(const mesh_face_t* mf) {
-	return mf->mesh_vertices[mf->a - 1];
+// mesh_build_positions moves the mesh's vertices into position streams for the vertex stage, unless
+// they have already been quantized into streams of their own. The vertex array is freed, so it must
+// not be used by anything that runs after loading.
+static void mesh_build_positions(mesh_t* mesh) {
+	int len = array_len(mesh->vertices);
+	if (!mesh->is_quantized) {
+		mesh->positions.x = stream_alloc(len);
+		mesh->positions.y = stream_alloc(len);
+		mesh->positions.z = stream_alloc(len);
+		for (int i = 0; i < len; i++) {
+			mesh->positions.x[i] = mesh->vertices[i].x;
+			mesh->positions.y[i] = mesh->vertices[i].y;
+			mesh->positions.z[i] = mesh->vertices[i].z;
+		}
+	}
+
+	mesh->positions.len = len;
+	array_free(mesh->vertices);
+	mesh->vertices = NULL;
+}
+
+// Returns v as a fraction of the range starting at min whose quantized steps are step apart, rounded
+// to the nearest step. Values outside the range are clamped to it.
+static uint16_t quantize_component(float v, float min, float step) {
+	if (step == 0) {
+		return 0;
+	}
+	float q = (v - min) / step + 0.5f;
+	return q <= 0 ? 0 : q >= QUANTIZED_MAX ? QUANTIZED_MAX : (uint16_t)q;
 }
 
-vec3_t mesh_face_vertex_b(const mesh_face_t* mf) {
-	return mf->mesh_vertices[mf->b - 1];
+static float dequantize_component(uint16_t q, float bias, float scale) {
+	return bias + q * scale;
 }
 
-vec3_t mesh_face_vertex_c(const mesh_face_t* mf) {
-	return mf->mesh_vertices[mf->c - 1];
+// mesh_quantize stores the positions and tex coords of the mesh's vertices as 16-bit fractions of
+// their bounds, which are measured over the vertices of its clusters alone so that the padding between
+// them doesn't stretch the range. The vertex array is rounded to the quantized positions, so that
+// everything built from it afterwards matches what the vertex stage will see, and the bounding spheres
+// of the clusters, already built, are grown by the most that rounding can move a vertex. Must be called
+// once the mesh's clusters have been built and while its vertex array is still populated.
+static void mesh_quantize(mesh_t* mesh) {
+	vec3_t min = { INFINITY, INFINITY, INFINITY };
+	vec3_t max = { -INFINITY, -INFINITY, -INFINITY };
+	tex2_t uv_min = { INFINITY, INFINITY };
+	tex2_t uv_max = { -INFINITY, -INFINITY };
+	int n_clusters = array_len(mesh->clusters);
+	for (int i = 0; i < n_clusters; i++) {
+		const cluster_t* c = &mesh->clusters[i];
+		for (int j = c->first_vertex; j < c->first_vertex + c->n_vertices; j++) {
+			vec3_t v = mesh->vertices[j];
+			tex2_t uv = mesh->tex_coords[j];
+			min = (vec3_t){ fminf(min.x, v.x), fminf(min.y, v.y), fminf(min.z, v.z) };
+			max = (vec3_t){ fmaxf(max.x, v.x), fmaxf(max.y, v.y), fmaxf(max.z, v.z) };
+			uv_min = (tex2_t){ fminf(uv_min.u, uv.u), fminf(uv_min.v, uv.v) };
+			uv_max = (tex2_t){ fmaxf(uv_max.u, uv.u), fmaxf(uv_max.v, uv.v) };
+		}
+	}
+	if (min.x > max.x) {
+		return; // the mesh has no vertices
+	}
+
+	mesh_quantization_t q = {
+		.position_scale = {
+			(max.x - min.x) / QUANTIZED_MAX,
+			(max.y - min.y) / QUANTIZED_MAX,
+			(max.z - min.z) / QUANTIZED_MAX,
+		},
+		.position_bias = min,
+		.uv_scale = { (uv_max.u - uv_min.u) / QUANTIZED_MAX, (uv_max.v - uv_min.v) / QUANTIZED_MAX },
+		.uv_bias = uv_min,
+	};
+	int len = array_len(mesh->vertices);
+	mesh_positions_t* p = &mesh->positions;
+	p->qx = stream_alloc_u16(len);
+	p->qy = stream_alloc_u16(len);
+	p->qz = stream_alloc_u16(len);
+	mesh->quantized_tex_coords = array_hold(NULL, len, sizeof(quantized_tex2_t));
+	for (int i = 0; i < len; i++) {
+		vec3_t* v = &mesh->vertices[i];
+		p->qx[i] = quantize_component(v->x, min.x, q.position_scale.x);
+		p->qy[i] = quantize_component(v->y, min.y, q.position_scale.y);
+		p->qz[i] = quantize_component(v->z, min.z, q.position_scale.z);
+		v->x = dequantize_component(p->qx[i], min.x, q.position_scale.x);
+		v->y = dequantize_component(p->qy[i], min.y, q.position_scale.y);
+		v->z = dequantize_component(p->qz[i], min.z, q.position_scale.z);
+
+		tex2_t uv = mesh->tex_coords[i];
+		mesh->quantized_tex_coords[i] = (quantized_tex2_t){
+			.u = quantize_component(uv.u, uv_min.u, q.uv_scale.u),
+			.v = quantize_component(uv.v, uv_min.v, q.uv_scale.v),
+		};
+	}
+	array_free(mesh->tex_coords);
+	mesh->tex_coords = NULL;
+
+	float max_error = vec3_magnitude(&q.position_scale) / 2;
+	for (int i = 0; i < n_clusters; i++) {
+		mesh->clusters[i].radius += max_error;
+	}
+	mesh->quantization = q;
+	mesh->is_quantized = true;
 }
 
-tex2_t mesh_face_tex_a(const mesh_face_t* mf) {
-	return mf->mesh_tex_coords[mf->a_uv - 1];
+// mesh_build_normals computes the normal of every face once, so that culling and lighting need
+// only a dot product per face each frame.
+static void mesh_build_normals(mesh_t* mesh) {
+	int n_faces = array_len(mesh->faces);
+	array_reset(mesh->normals, sizeof(vec3_t));
+	mesh->normals = array_hold(mesh->normals, n_faces, sizeof(vec3_t));
+	for (int i = 0; i < n_faces; i++) {
+		mesh->normals[i] = mesh_face_normal(mesh, &mesh->faces[i]);
+	}
 }
 
-tex2_t mesh_face_tex_b(const mesh_face_t* mf) {
-	return mf->mesh_tex_coords[mf->b_uv - 1];
+// mesh_prepare builds everything the pipeline needs from a freshly parsed mesh. Levels of detail are
+// not given BSP trees, whose splits would undo much of their simplification; they are depth sorted
+// instead.
+static void mesh_prepare(mesh_t* mesh, bool is_lod, bool quantize) {
+	mesh->is_convex = mesh_is_convex(mesh);
+	if (!mesh->is_convex && !is_lod && array_len(mesh->faces) <= BSP_MAX_FACES) {
+		bsp_build(&mesh->bsp, mesh);
+	}
+	mesh_build_normals(mesh);
+	cluster_build(mesh);
+	if (quantize) {
+		mesh_quantize(mesh);
+	}
+	bvh_build(&mesh->bvh, mesh);
+	mesh_build_positions(mesh);
 }
 
-tex2_t mesh_face_tex_c(const mesh_face_t* mf) {
-	return mf->mesh_tex_coords[mf->c_uv - 1];
+// mesh_build_lods simplifies each level from the freshly parsed level before it, since preparing a
+// mesh splits and duplicates its vertices.
+static void mesh_build_lods(mesh_t* mesh, bool lock_borders) {
+	mesh_t* finer = mesh;
+	int n_faces = array_len(finer->faces);
+	while (n_faces / 2 >= LOD_MIN_FACES) {
+		mesh_t* coarser = must_malloc(sizeof(mesh_t));
+		*coarser = new_mesh();
+		simplify_mesh(finer, coarser, n_faces / 2, lock_borders);
+		int n_coarser_faces = array_len(coarser->faces);
+		if (n_coarser_faces > n_faces * (1 - LOD_MIN_REDUCTION)) {
+			mesh_free(coarser);
+			free(coarser);
+			break;
+		}
+
+		finer->coarser = coarser;
+		finer = coarser;
+		n_faces = n_coarser_faces;
+	}
 }
 
-int parse_uv(const char* line, mesh_t* dst) {
-	tex2_t tex;
-	int filled = sscanf(line, "vt %f %f", &tex.u, &tex.v);
-	if (filled < 2) {
-		fprintf(stderr, "failed to parse UV data for line \"%s\"\n", line);
-		return -1;
+int load_mesh(mesh_t* dst, const char* path, bool build_lods, bool quantize, job_system_t* jobs) {
+	if (mesh_cache_load(dst, path, build_lods, quantize)) {
+		return 0;
+	}
+
+	int err = parse_obj_file(path, dst, jobs);
+	if (err) {
+		return err;
 	}
 
-	array_push(dst->tex_coords, tex);
+	if (build_lods) {
+		mesh_build_lods(dst, false);
+	}
+	for (mesh_t* mesh = dst; mesh != NULL; mesh = mesh->coarser) {
+		mesh_prepare(mesh, mesh != dst, quantize);
+	}
+	mesh_cache_write(dst, path, build_lods, quantize);
 	return 0;
 }
 
-int parse_vertex(const char* line, mesh_t* dst) {
-	vec3_t v;
-	int filled = sscanf(line, "v %f %f %f", &v.x, &v.y, &v.z);
-	if (filled < 3) {
-		fprintf(stderr, "failed to parse vertex for line \"%s\"\n", line);
-		return -1;
+void mesh_prepare_chunk(mesh_t* mesh) {
+	mesh_build_lods(mesh, true);
+	for (mesh_t* level = mesh; level != NULL; level = level->coarser) {
+		mesh_prepare(level, true, false);
 	}
+}
 
-	array_push(dst->vertices, v);
-	return 0;
+const mesh_t* mesh_select_lod(const mesh_t* mesh, int max_faces) {
+	while (array_len(mesh->faces) > max_faces && mesh->coarser != NULL) {
+		mesh = mesh->coarser;
+	}
+	return mesh;
 }
 
-// parse_face parses a single face from an obj file.
-int parse_face(const char* line, mesh_t* dst) {
-	mesh_face_t face = new_mesh_face(dst->vertices, dst->tex_coords);
-	mesh_face_t normal;
-	int filled = sscanf(
-		line,
-		"f %d/%d/%d %d/%d/%d %d/%d/%d",
-		&face.a, &face.a_uv, &normal.a,
-		&face.b, &face.b_uv, &normal.b,
-		&face.c, &face.c_uv, &normal.c
-	);
-	if (filled < 9) {
-		fprintf(stderr, "failed to parse face for line \"%s\"\n", line);
-		return -1;
+vec3_t mesh_position(const mesh_t* mesh, int i) {
+	const mesh_positions_t* p = &mesh->positions;
+	if (mesh->is_quantized) {
+		const mesh_quantization_t* q = &mesh->quantization;
+		return (vec3_t){
+			dequantize_component(p->qx[i], q->position_bias.x, q->position_scale.x),
+			dequantize_component(p->qy[i], q->position_bias.y, q->position_scale.y),
+			dequantize_component(p->qz[i], q->position_bias.z, q->position_scale.z),
+		};
 	}
+	return (vec3_t){ p->x[i], p->y[i], p->z[i] };
+}
 
-	array_push(dst->faces, face);
-	return 0;
+tex2_t mesh_tex_coord(const mesh_t* mesh, int i) {
+	if (mesh->is_quantized) {
+		const mesh_quantization_t* q = &mesh->quantization;
+		quantized_tex2_t uv = mesh->quantized_tex_coords[i];
+		return (tex2_t){
+			dequantize_component(uv.u, q->uv_bias.u, q->uv_scale.u),
+			dequantize_component(uv.v, q->uv_bias.v, q->uv_scale.v),
+		};
+	}
+	return mesh->tex_coords[i];
 }
 
-int parse_line(const char* line, mesh_t* dst) {
-	int err = 0;
-	if (strncmp(line, "v ", 2) == 0) {
-		err = parse_vertex(line, dst);
-	}  else if (strncmp(line, "vt ", 3) == 0) {
-		err = parse_uv(line, dst);
-	} else if (strncmp(line, "f ", 2) == 0) {
-		err = parse_face(line, dst);
+mat4_t mesh_dequantize_matrix(const mesh_t* mesh) {
+	if (!mesh->is_quantized) {
+		return mat4_identity();
 	}
+	const mesh_quantization_t* q = &mesh->quantization;
+	mat4_t scale = mat4_make_scale(q->position_scale.x, q->position_scale.y, q->position_scale.z);
+	mat4_t bias = mat4_make_translation(q->position_bias.x, q->position_bias.y, q->position_bias.z);
+	return mat4_mul(&bias, &scale);
+}
 
-	return err;
+vec3_t mesh_face_normal(const mesh_t* mesh, const mesh_face_t* mf) {
+	vec3_t a = mesh->vertices[mf->a];
+	vec3_t b = mesh->vertices[mf->b];
+	vec3_t c = mesh->vertices[mf->c];
+	vec3_t ab = vec3_sub(&b, &a);
+	vec3_t ac = vec3_sub(&c, &a);
+	vec3_t cross = vec3_cross(&ac, &ab);
+	float magnitude = vec3_magnitude(&cross);
+	if (magnitude == 0 || !isfinite(magnitude)) {
+		return (vec3_t){ 0, 0, 0 };
+	}
+	return vec3_sdiv(&cross, magnitude);
 }
 
-// parse_obj_file takes the path of the obj file and the dynamic arrays vert_out and face_out to
-// write vertex and face data to, respectively.
-int parse_obj_file(const char* path, mesh_t* dst) {
-	FILE* obj = must_fopen(path, "r");
-	char line[MAX_LINE];
-	while (fgets(line, MAX_LINE, obj) != NULL) {
-		int err = parse_line(line, dst);
-		if (err) {
-			return -1;
-		}
+void mesh_free(mesh_t* mesh) {
+	if (!mesh->is_cached) {
+		array_free(mesh->vertices);
+		array_free(mesh->faces);
+		array_free(mesh->face_uvs);
+		array_free(mesh->normals);
+		array_free(mesh->tex_coords);
+		array_free(mesh->quantized_tex_coords);
+		array_free(mesh->clusters);
+		array_free(mesh->face_clusters);
+		stream_free(mesh->positions.x);
+		stream_free(mesh->positions.y);
+		stream_free(mesh->positions.z);
+		stream_free(mesh->positions.qx);
+		stream_free(mesh->positions.qy);
+		stream_free(mesh->positions.qz);
+		bsp_free(&mesh->bsp);
+		bvh_free(&mesh->bvh);
 	}
-	if (!feof(obj)) {
-		fprintf(stderr, "failed to read to end of %s\n", path);
-		return -1;
+	if (mesh->coarser != NULL) {
+		mesh_free(mesh->coarser);
+		free(mesh->coarser);
+		mesh->coarser = NULL;
 	}
-	fclose(obj);
-	return 0;
+	unmap_file(&mesh->cache);
 }
 
-int load_mesh(const char* path) {
-	return parse_obj_file(path, &g_mesh);
+float mesh_extent(const mesh_t* mesh) {
+	float extent = 0;
+	int n_vertices = array_len(mesh->vertices);
+	for (int i = 0; i < n_vertices; i++) {
+		vec3_t v = mesh->vertices[i];
+		extent = fmaxf(extent, fmaxf(fabsf(v.x), fmaxf(fabsf(v.y), fabsf(v.z))));
+	}
+	return extent;
+}
+
+// Returns the root of the set containing face i, halving the path to it along the way.
+static int find_root(int* parent, int i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+// mesh_is_convex checks that every directed edge appears once and is matched by its reverse in a
+// neighbouring face, that the vertex of the neighbour opposite each edge lies behind the face, and
+// that the faces form a single connected surface. A closed, connected surface that folds away from
+// the front of its faces at every edge bounds a convex solid.
+bool mesh_is_convex(const mesh_t* mesh) {
+	int n_faces = array_len(mesh->faces);
+	if (n_faces == 0) {
+		return false;
+	}
+
+	// A repeated directed edge means the surface is non-manifold or inconsistently wound.
+	edge_table_t edges = new_edge_table(n_faces * 3);
+	bool convex = true;
+	for (int i = 0; i < n_faces && convex; i++) {
+		const mesh_face_t* f = &mesh->faces[i];
+		convex = edge_table_insert(&edges, f->a, f->b, i) &&
+			edge_table_insert(&edges, f->b, f->c, i) &&
+			edge_table_insert(&edges, f->c, f->a, i);
+	}
+
+	float epsilon = CONVEX_EPSILON * mesh_extent(mesh);
+	int* parent = must_malloc(sizeof(int) * n_faces);
+	for (int i = 0; i < n_faces; i++) {
+		parent[i] = i;
+	}
+
+	for (int i = 0; i < n_faces && convex; i++) {
+		const mesh_face_t* f = &mesh->faces[i];
+		vec3_t a = mesh->vertices[f->a];
+		vec3_t normal = mesh_face_normal(mesh, f);
+		int corners[3] = { f->a, f->b, f->c };
+		for (int j = 0; j < 3 && convex; j++) {
+			int from = corners[j];
+			int to = corners[(j + 1) % 3];
+			int neighbour_index = edge_table_find(&edges, to, from);
+			if (neighbour_index < 0) {
+				convex = false; // the surface has a hole
+				break;
+			}
+
+			const mesh_face_t* neighbour = &mesh->faces[neighbour_index];
+			int opposite = neighbour->a;
+			if (opposite == from || opposite == to) {
+				opposite = (neighbour->b == from || neighbour->b == to) ? neighbour->c : neighbour->b;
+			}
+			vec3_t p = mesh->vertices[opposite];
+			vec3_t ap = vec3_sub(&p, &a);
+			if (vec3_dot(&normal, &ap) > epsilon) {
+				convex = false; // the surface folds towards the front of the face
+			}
+
+			parent[find_root(parent, i)] = find_root(parent, neighbour_index);
+		}
+	}
+
+	int root = find_root(parent, 0);
+	for (int i = 1; i < n_faces && convex; i++) {
+		convex = find_root(parent, i) == root;
+	}
+
+	free(parent);
+	edge_table_free(&edges);
+	return convex;
 }
 
-mat4_t mesh_to_world_matrix(const mesh_t* mesh) {
-	mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-	mat4_t translation_matrix = mat4_make_translation(mesh->translation.x, mesh->translation.y, mesh->translation.z);
-	mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh->rotation.x);
-	mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh->rotation.y);
-	mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
+void mesh_reorder_faces(mesh_t* mesh, const int* order) {
+	int n_faces = array_len(mesh->faces);
+	mesh_face_t* faces = must_malloc(sizeof(mesh_face_t) * n_faces);
+	vec3_t* normals = must_malloc(sizeof(vec3_t) * n_faces);
+	int* new_index = must_malloc(sizeof(int) * n_faces);
+	for (int i = 0; i < n_faces; i++) {
+		faces[i] = mesh->faces[order[i]];
+		normals[i] = mesh->normals[order[i]];
+		new_index[order[i]] = i;
+	}
+	memcpy(mesh->faces, faces, sizeof(mesh_face_t) * n_faces);
+	memcpy(mesh->normals, normals, sizeof(vec3_t) * n_faces);
+	if (mesh->face_uvs != NULL) {
+		for (int i = 0; i < n_faces; i++) {
+			faces[i] = mesh->face_uvs[order[i]];
+		}
+		memcpy(mesh->face_uvs, faces, sizeof(mesh_face_t) * n_faces);
+	}
+
+	int n_bsp_faces = array_len(mesh->bsp.faces);
+	for (int i = 0; i < n_bsp_faces; i++) {
+		mesh->bsp.faces[i] = new_index[mesh->bsp.faces[i]];
+	}
 
-	// Order matters b/c transformations are centred on the origin: scale -> rotate -> translate.
-	mat4_t world_matrix = mat4_mul(&rotation_matrix_z, &scale_matrix);
-	world_matrix = mat4_mul(&rotation_matrix_y, &world_matrix);
-	world_matrix = mat4_mul(&rotation_matrix_x, &world_matrix);
-	return mat4_mul(&translation_matrix, &world_matrix);
+	free(new_index);
+	free(normals);
+	free(faces);
 }
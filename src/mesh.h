@@ -4,12 +4,19 @@
 #define MESH_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "array.h"
+#include "bsp.h"
+#include "bvh.h"
+#include "cluster.h"
 #include "color.h"
+#include "file.h"
+#include "job.h"
 #include "must.h"
+#include "stream.h"
 #include "texture.h"
 #include "vector.h"
 
@@ -25,52 +32,118 @@ Constants
 Structs
 */
 
-// mesh_face_t stores the indices of 3 vectors in 3D space that represent the vertices a triangular
-// face.
+// mesh_face_t stores the 0-based indices of the 3 vertices of a triangular face in its mesh's arrays.
 typedef struct mesh_face_t {
-	int a, b, c;
-	int a_uv, b_uv, c_uv;
-	const vec3_t* mesh_vertices;
-	const tex2_t* mesh_tex_coords;
-	color_t color;
+	uint32_t a, b, c;
 } mesh_face_t;
 
-// mesh_t represents a whole 3D object and its position in space.
+// mesh_positions_t stores the positions of a mesh's vertices as separate x, y and z streams, ready
+// to be transformed in batches by the vertex stage.
+typedef struct mesh_positions_t {
+	float* x; // NULL if the mesh is quantized
+	float* y;
+	float* z;
+	uint16_t* qx; // quantized streams replacing x, y and z if the mesh is quantized, or NULL
+	uint16_t* qy;
+	uint16_t* qz;
+	int len;
+} mesh_positions_t;
+
+// quantized_tex2_t stores a tex coord as 16-bit fractions of the range of its mesh's tex coords.
+typedef struct quantized_tex2_t {
+	uint16_t u;
+	uint16_t v;
+} quantized_tex2_t;
+
+// mesh_quantization_t maps the quantized positions and tex coords of a mesh back to their values,
+// each component being its bias plus its quantized value times its scale.
+typedef struct mesh_quantization_t {
+	vec3_t position_scale;
+	vec3_t position_bias;
+	tex2_t uv_scale;
+	tex2_t uv_bias;
+} mesh_quantization_t;
+
+// mesh_t represents the geometry of a whole 3D object in model space, which may be shared by any
+// number of instances in a scene.
 typedef struct mesh_t {
-	vec3_t* vertices; // dynamic array
+	vec3_t* vertices; // dynamic array, moved into positions once loading is complete
+	mesh_positions_t positions;
 	mesh_face_t* faces; // dynamic array
-	tex2_t* tex_coords; // dynamic array
-	vec3_t rotation;
-	vec3_t scale;
-	vec3_t translation;
+	mesh_face_t* face_uvs; // dynamic array of tex coord indices indexed like faces, only while loading
+	vec3_t* normals; // dynamic array of unit face normals in model space, indexed like faces
+	tex2_t* tex_coords; // dynamic array, indexed like vertices once loading is complete
+	quantized_tex2_t* quantized_tex_coords; // dynamic array replacing tex_coords if the mesh is quantized
+	cluster_t* clusters; // dynamic array of clusters covering the faces in order
+	int* face_clusters; // dynamic array of the index of each face's cluster, indexed like faces
+	bvh_t bvh; // bounding volume hierarchy over the clusters
+	bsp_tree_t bsp; // back-to-front face ordering for rigid meshes
+	bool is_convex; // true if the mesh is closed and convex, so culling alone resolves visibility
+	bool is_quantized; // true if positions and tex coords are stored in 16 bits per component
+	mesh_quantization_t quantization; // meaningful only if the mesh is quantized
+	struct mesh_t* coarser; // the next simpler level of detail, owned by this mesh, or NULL
+	bool is_cached; // true if the mesh's arrays view a mapped cache file rather than being owned
+	mapped_file_t cache; // the cache file mapped for this mesh and its levels of detail, if any
 } mesh_t;
 
-// Global mesh.
-extern mesh_t g_mesh;
-
 /*
 Functions
 */
 
-// Getters to expedite vertex lookup.
-vec3_t mesh_face_vertex_a(const mesh_face_t* mf);
-vec3_t mesh_face_vertex_b(const mesh_face_t* mf);
-vec3_t mesh_face_vertex_c(const mesh_face_t* mf);
-
-// Getters to expedite tex lookup.
-tex2_t mesh_face_tex_a(const mesh_face_t* mf);
-tex2_t mesh_face_tex_b(const mesh_face_t* mf);
-tex2_t mesh_face_tex_c(const mesh_face_t* mf);
-
 // Load a cube from hard-coded vertices and texture data.
 void load_cube(void);
 
-// Load a mesh from the given .obj file.
-int load_mesh(const char* path);
-
-// Returns a matrix representing the current scale, position and orientation of the mesh in space,
-// which can be used to transform each face ready for projection onto the viewing plane.
-mat4_t mesh_to_world_matrix(const mesh_t* mesh);
+// Construct an empty mesh.
+mesh_t new_mesh(void);
+
+// Load a mesh from the given .obj file into dst, computing its face normals, partitioning its faces
+// into clusters bounded by a BVH and determining whether it is convex. Non-convex meshes have a BSP
+// tree built for them unless they are very large. If build_lods is set, a chain of simplified levels
+// of detail is built from the mesh, each with about half the faces of the last and no BSP tree. If
+// quantize is set, each level's positions and tex coords are stored in 16 bits per component,
+// relative to their bounds, halving the memory they take and the bandwidth of the vertex stage. The
+// file is parsed on the job system, and the prepared mesh is cached next to it so that later loads of
+// the unchanged file map the cache instead.
+int load_mesh(mesh_t* dst, const char* path, bool build_lods, bool quantize, job_system_t* jobs);
+
+// Prepare a freshly parsed chunk cut from a mesh too large to load whole as load_mesh prepares a mesh
+// with levels of detail, without caching it. Vertices on the borders of the chunk are never
+// simplified away, so that its levels meet those of neighbouring chunks whichever are drawn. Chunks
+// are drawn together and depth sorted, so no level is given a BSP tree, and none is quantized, since
+// the vertices a chunk shares with its neighbours must keep exactly the same positions.
+void mesh_prepare_chunk(mesh_t* mesh);
+
+// Returns the position of the vertex at the 0-based index i, once loading is complete.
+vec3_t mesh_position(const mesh_t* mesh, int i);
+
+// Returns the tex coord of the vertex at the 0-based index i, once loading is complete.
+tex2_t mesh_tex_coord(const mesh_t* mesh, int i);
+
+// Returns the matrix mapping the positions stored in the mesh's streams to model space, which is the
+// identity unless the mesh is quantized. Folding it into the matrix the vertex stage applies lets
+// quantized positions be transformed at no extra cost.
+mat4_t mesh_dequantize_matrix(const mesh_t* mesh);
+
+// Returns the unit normal of the face in model space, pointing out of its front, or the zero vector
+// if the face has no area. Must be called while the mesh's vertex array is still populated.
+vec3_t mesh_face_normal(const mesh_t* mesh, const mesh_face_t* mf);
+
+// Returns the most detailed level in the mesh's chain of levels of detail with no more than max_faces
+// faces, or the coarsest level if every level has more.
+const mesh_t* mesh_select_lod(const mesh_t* mesh, int max_faces);
+
+// Free the memory associated with the mesh and its levels of detail.
+void mesh_free(mesh_t* mesh);
+
+// Returns the largest absolute value of any vertex component of the mesh.
+float mesh_extent(const mesh_t* mesh);
+
+// Returns true if the mesh is a single closed, consistently wound surface that bounds a convex solid.
+bool mesh_is_convex(const mesh_t* mesh);
+
+// Rearrange the mesh's faces and everything indexed like them so that the face at index i moves to
+// the index j where order[j] == i.
+void mesh_reorder_faces(mesh_t* mesh, const int* order);
 
 
 
@@ -20,3 +20,23 @@ void* must_malloc(size_t t) {
 
 	return p;
 }
+
+void* must_calloc(size_t n, size_t t) {
+	void* p = calloc(n, t);
+	if (p == NULL) {
+		fprintf(stderr, "failed to allocate %zu elements of %zu bytes\n", n, t);
+		abort();
+	}
+
+	return p;
+}
+
+void* must_aligned_alloc(size_t alignment, size_t t) {
+	void* p = aligned_alloc(alignment, t);
+	if (p == NULL) {
+		fprintf(stderr, "failed to allocate %zu bytes aligned to %zu\n", t, alignment);
+		abort();
+	}
+
+	return p;
+}
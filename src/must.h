@@ -11,4 +11,11 @@ FILE* must_fopen(const char* path, char* mode);
 // Allocate the requested memory or abort.
 void* must_malloc(size_t t);
 
+// Allocate zeroed memory for n elements of size t each or abort.
+void* must_calloc(size_t n, size_t t);
+
+// Allocate the requested memory at an address that is a multiple of alignment or abort. t must be a
+// multiple of alignment.
+void* must_aligned_alloc(size_t alignment, size_t t);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,480 @@
+// _DEFAULT_SOURCE exposes madvise under -std=c17.
+#define _DEFAULT_SOURCE
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "obj.h"
+
+// Approximate size in bytes of the chunks of a file that are counted and parsed as separate tasks.
+// Chunks end at the first line break after this many bytes.
+#define OBJ_CHUNK_SIZE (1 << 20)
+
+// Longest number that is copied out of the file to be parsed by strtof, which handles the forms the
+// fast path rejects.
+#define MAX_NUMBER_LEN 64
+
+// Powers of ten that are exactly representable as doubles.
+static const double POW10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// obj_line_t identifies the statements of an .obj file that are parsed.
+typedef enum obj_line_t {
+	OBJ_LINE_OTHER,
+	OBJ_LINE_VERTEX,
+	OBJ_LINE_UV,
+	OBJ_LINE_FACE,
+} obj_line_t;
+
+// obj_chunk_t is a run of whole lines of an .obj file that is counted and parsed by a single task.
+typedef struct obj_chunk_t {
+	const char* start;
+	const char* end;
+	obj_counts_t counts; // statements of each kind in the chunk
+	obj_counts_t offsets; // index in the mesh's arrays of the chunk's first statement of each kind
+	int err;
+} obj_chunk_t;
+
+// obj_parse_t is the context shared by the tasks that count and parse the chunks of a file.
+typedef struct obj_parse_t {
+	obj_chunk_t* chunks; // dynamic array
+	obj_counts_t totals; // statements of each kind in the whole file
+	mesh_t* dst;
+} obj_parse_t;
+
+static obj_line_t obj_line_kind(const char* line, const char* end) {
+	size_t len = end - line;
+	if (len >= 2 && line[0] == 'v' && line[1] == ' ') {
+		return OBJ_LINE_VERTEX;
+	} else if (len >= 3 && line[0] == 'v' && line[1] == 't' && line[2] == ' ') {
+		return OBJ_LINE_UV;
+	} else if (len >= 2 && line[0] == 'f' && line[1] == ' ') {
+		return OBJ_LINE_FACE;
+	}
+	return OBJ_LINE_OTHER;
+}
+
+// Returns the end of the line beginning at p, excluding its newline.
+static const char* line_end(const char* p, const char* end) {
+	const char* newline = memchr(p, '\n', end - p);
+	return newline != NULL ? newline : end;
+}
+
+static bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static bool is_delimiter(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '/';
+}
+
+static const char* skip_spaces(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	return p;
+}
+
+// scan_int parses a non-negative decimal integer at *p, advancing *p past it.
+static bool scan_int(const char** p, const char* end, int* out) {
+	const char* s = *p;
+	if (s == end || !is_digit(*s)) {
+		return false;
+	}
+
+	int64_t v = 0;
+	while (s < end && is_digit(*s)) {
+		v = v * 10 + (*s - '0');
+		if (v > INT32_MAX) {
+			return false;
+		}
+		s++;
+	}
+	*p = s;
+	*out = v;
+	return true;
+}
+
+// scan_float_slow parses the number at *p with strtof, advancing *p past it.
+static bool scan_float_slow(const char** p, const char* end, float* out) {
+	const char* s = *p;
+	while (s < end && !is_delimiter(*s)) {
+		s++;
+	}
+	size_t len = s - *p;
+	if (len == 0 || len >= MAX_NUMBER_LEN) {
+		return false;
+	}
+
+	char number[MAX_NUMBER_LEN];
+	memcpy(number, *p, len);
+	number[len] = '\0';
+	char* parsed_end;
+	*out = strtof(number, &parsed_end);
+	if (parsed_end != number + len) {
+		return false;
+	}
+	*p = s;
+	return true;
+}
+
+// scan_float parses a decimal number at *p, advancing *p past it. The digits are gathered into an
+// integer that is scaled by an exact power of ten, which rounds correctly whenever both fit in a
+// double. Everything else, including the rare results that would round differently when narrowed
+// from double to float, is left to strtof, so the result always matches it.
+static bool scan_float(const char** p, const char* end, float* out) {
+	const char* s = *p;
+	bool is_negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		is_negative = *s == '-';
+		s++;
+	}
+
+	uint64_t mantissa = 0;
+	int n_digits = 0; // significant digits in mantissa
+	int exponent = 0;
+	bool has_digits = false;
+	bool is_truncated = false;
+	for (; s < end && is_digit(*s); s++) {
+		has_digits = true;
+		if (n_digits < 19) {
+			mantissa = mantissa * 10 + (*s - '0');
+			n_digits += mantissa != 0;
+		} else {
+			is_truncated = true;
+			exponent++;
+		}
+	}
+	if (s < end && *s == '.') {
+		for (s++; s < end && is_digit(*s); s++) {
+			has_digits = true;
+			if (n_digits < 19) {
+				mantissa = mantissa * 10 + (*s - '0');
+				n_digits += mantissa != 0;
+				exponent--;
+			} else {
+				is_truncated = true;
+			}
+		}
+	}
+	if (has_digits && s < end && (*s == 'e' || *s == 'E')) {
+		const char* e = s + 1;
+		bool is_exponent_negative = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			is_exponent_negative = *e == '-';
+			e++;
+		}
+		int explicit_exponent;
+		if (!scan_int(&e, end, &explicit_exponent) || explicit_exponent > 1000) {
+			return scan_float_slow(p, end, out);
+		}
+		exponent += is_exponent_negative ? -explicit_exponent : explicit_exponent;
+		s = e;
+	}
+	if (!has_digits || is_truncated || (s < end && !is_delimiter(*s))) {
+		return scan_float_slow(p, end, out);
+	}
+	if (mantissa == 0) {
+		*out = is_negative ? -0.0f : 0.0f;
+		*p = s;
+		return true;
+	}
+	if (mantissa > (1ull << 53) || exponent < -22 || exponent > 22) {
+		return scan_float_slow(p, end, out);
+	}
+
+	double d = exponent < 0 ? mantissa / POW10[-exponent] : mantissa * POW10[exponent];
+	// Narrowing is only ambiguous if d lies exactly halfway between two floats, which shows as the
+	// 29 bits of the double's mantissa below the float's being 1 followed by zeros.
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	if ((bits & ((1ull << 29) - 1)) == (1ull << 28) || d < FLT_MIN || d > FLT_MAX) {
+		return scan_float_slow(p, end, out);
+	}
+	*out = is_negative ? -(float)d : (float)d;
+	*p = s;
+	return true;
+}
+
+// scan_floats parses n whitespace-separated numbers beginning at p.
+static bool scan_floats(const char* p, const char* end, float* out, int n) {
+	for (int i = 0; i < n; i++) {
+		p = skip_spaces(p, end);
+		if (!scan_float(&p, end, &out[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// scan_face_vertex parses a face vertex of the form v/vt or v/vt/vn beginning at *p, discarding vn.
+static bool scan_face_vertex(const char** p, const char* end, int* v, int* vt) {
+	const char* s = skip_spaces(*p, end);
+	if (!scan_int(&s, end, v) || s == end || *s != '/') {
+		return false;
+	}
+	s++;
+	if (!scan_int(&s, end, vt)) {
+		return false;
+	}
+	if (s < end && *s == '/') {
+		s++;
+		int vn;
+		if (!scan_int(&s, end, &vn)) {
+			return false;
+		}
+	}
+	*p = s;
+	return true;
+}
+
+static int parse_vertex(const char* line, const char* end, vec3_t* dst) {
+	float xyz[3];
+	if (!scan_floats(line + 2, end, xyz, 3)) {
+		fprintf(stderr, "failed to parse vertex for line \"%.*s\"\n", (int)(end - line), line);
+		return -1;
+	}
+	// y-values must be inverted to account for the fact that models have their greatest value of y
+	// at the top, but our color buffer has its greatest value of y at the bottom. Doing so once at
+	// load time means model space matches the space transformed by the world matrix.
+	*dst = (vec3_t){ xyz[0], -xyz[1], xyz[2] };
+	return 0;
+}
+
+static int parse_uv(const char* line, const char* end, tex2_t* dst) {
+	float uv[2];
+	if (!scan_floats(line + 3, end, uv, 2)) {
+		fprintf(stderr, "failed to parse UV data for line \"%.*s\"\n", (int)(end - line), line);
+		return -1;
+	}
+	// v-values are inverted for the same reason as vertex y-values (see parse_vertex).
+	*dst = (tex2_t){ .u = uv[0], .v = 1 - uv[1] };
+	return 0;
+}
+
+// parse_face parses a single face from an obj file into the 0-based indices of its vertices and
+// their tex coords, of which the file has the numbers given by totals. Vertex normals are skipped,
+// since face normals are computed from the vertices once loaded.
+static int parse_face(
+	const char* line,
+	const char* end,
+	obj_counts_t totals,
+	mesh_face_t* dst,
+	mesh_face_t* dst_uvs
+) {
+	uint32_t* corners[3] = { &dst->a, &dst->b, &dst->c };
+	uint32_t* uvs[3] = { &dst_uvs->a, &dst_uvs->b, &dst_uvs->c };
+	const char* p = line + 2;
+	for (int i = 0; i < 3; i++) {
+		int v, vt;
+		if (
+			!scan_face_vertex(&p, end, &v, &vt) ||
+			v < 1 || v > totals.vertices ||
+			vt < 1 || vt > totals.uvs
+		) {
+			fprintf(stderr, "failed to parse face for line \"%.*s\"\n", (int)(end - line), line);
+			return -1;
+		}
+		*corners[i] = v - 1;
+		*uvs[i] = vt - 1;
+	}
+	return 0;
+}
+
+// count_lines counts the statements of each kind in the buffer, so that the mesh's arrays can be
+// allocated once before parsing.
+static obj_counts_t count_lines(const char* p, const char* end) {
+	obj_counts_t counts = { 0 };
+	while (p < end) {
+		const char* eol = line_end(p, end);
+		switch (obj_line_kind(p, eol)) {
+		case OBJ_LINE_VERTEX:
+			counts.vertices++;
+			break;
+		case OBJ_LINE_UV:
+			counts.uvs++;
+			break;
+		case OBJ_LINE_FACE:
+			counts.faces++;
+			break;
+		case OBJ_LINE_OTHER:
+			break;
+		}
+		p = eol + 1;
+	}
+	return counts;
+}
+
+// parse_lines parses every statement in the buffer into the mesh's arrays, beginning at the indices
+// given by n, which must have been sized by count_lines. Faces may refer to any of the file's
+// statements, of which there are totals.
+static int parse_lines(const char* p, const char* end, mesh_t* dst, obj_counts_t n, obj_counts_t totals) {
+	while (p < end) {
+		const char* eol = line_end(p, end);
+		int err = 0;
+		switch (obj_line_kind(p, eol)) {
+		case OBJ_LINE_VERTEX:
+			err = parse_vertex(p, eol, &dst->vertices[n.vertices++]);
+			break;
+		case OBJ_LINE_UV:
+			err = parse_uv(p, eol, &dst->tex_coords[n.uvs++]);
+			break;
+		case OBJ_LINE_FACE:
+			err = parse_face(p, eol, totals, &dst->faces[n.faces], &dst->face_uvs[n.faces]);
+			n.faces++;
+			break;
+		case OBJ_LINE_OTHER:
+			break;
+		}
+		if (err) {
+			return -1;
+		}
+		p = eol + 1;
+	}
+	return 0;
+}
+
+// split_chunks divides the buffer into chunks of whole lines.
+static obj_chunk_t* split_chunks(const char* p, const char* end) {
+	obj_chunk_t* chunks = NULL;
+	while (p < end) {
+		const char* chunk_end = (size_t)(end - p) > OBJ_CHUNK_SIZE ? line_end(p + OBJ_CHUNK_SIZE, end) : end;
+		if (chunk_end < end) {
+			chunk_end++;
+		}
+		obj_chunk_t chunk = { .start = p, .end = chunk_end };
+		array_push(chunks, chunk);
+		p = chunk_end;
+	}
+	return chunks;
+}
+
+static void count_chunk_task(void* ctx, int i) {
+	obj_parse_t* parse = ctx;
+	obj_chunk_t* chunk = &parse->chunks[i];
+	chunk->counts = count_lines(chunk->start, chunk->end);
+}
+
+static void parse_chunk_task(void* ctx, int i) {
+	obj_parse_t* parse = ctx;
+	obj_chunk_t* chunk = &parse->chunks[i];
+	chunk->err = parse_lines(chunk->start, chunk->end, parse->dst, chunk->offsets, parse->totals);
+}
+
+// Each chunk is counted and then parsed as its own task. Since faces index the file's vertices and
+// UVs absolutely, chunks are stitched together simply by writing each one's statements to the
+// mesh's arrays at the offsets given by the prefix sums of the counts of the chunks before it.
+int parse_obj_file(const char* path, mesh_t* dst, job_system_t* jobs) {
+	mapped_file_t obj;
+	if (!map_file(path, &obj)) {
+		fprintf(stderr, "failed to map %s\n", path);
+		return -1;
+	}
+
+	obj_parse_t parse = { .chunks = split_chunks(obj.data, obj.data + obj.size), .dst = dst };
+	int n_chunks = array_len(parse.chunks);
+	job_parallel_for(jobs, n_chunks, count_chunk_task, &parse);
+
+	obj_counts_t total = { 0 };
+	for (int i = 0; i < n_chunks; i++) {
+		obj_chunk_t* chunk = &parse.chunks[i];
+		chunk->offsets = total;
+		total.vertices += chunk->counts.vertices;
+		total.uvs += chunk->counts.uvs;
+		total.faces += chunk->counts.faces;
+	}
+	parse.totals = total;
+	if (total.vertices > 0) {
+		dst->vertices = array_hold(dst->vertices, total.vertices, sizeof(vec3_t));
+	}
+	if (total.uvs > 0) {
+		dst->tex_coords = array_hold(dst->tex_coords, total.uvs, sizeof(tex2_t));
+	}
+	if (total.faces > 0) {
+		dst->faces = array_hold(dst->faces, total.faces, sizeof(mesh_face_t));
+		dst->face_uvs = array_hold(dst->face_uvs, total.faces, sizeof(mesh_face_t));
+	}
+
+	job_parallel_for(jobs, n_chunks, parse_chunk_task, &parse);
+	int err = 0;
+	for (int i = 0; i < n_chunks; i++) {
+		if (parse.chunks[i].err) {
+			err = -1;
+		}
+	}
+	array_free(parse.chunks);
+	unmap_file(&obj);
+	return err;
+}
+
+// Writes the first n elements of each of the mesh's arrays to the matching file.
+static bool write_arrays(const mesh_t* mesh, obj_counts_t n, FILE* vertices, FILE* uvs, FILE* faces) {
+	bool ok = fwrite(mesh->vertices, sizeof(vec3_t), n.vertices, vertices) == (size_t)n.vertices;
+	ok &= fwrite(mesh->tex_coords, sizeof(tex2_t), n.uvs, uvs) == (size_t)n.uvs;
+	for (int i = 0; i < n.faces && ok; i++) {
+		mesh_face_t face[2] = { mesh->faces[i], mesh->face_uvs[i] };
+		ok = fwrite(face, sizeof(face), 1, faces) == 1;
+	}
+	return ok;
+}
+
+// release_chunk releases the pages of the mapped chunk once it has been read, rather than leaving them
+// to accumulate. The last may be shared with the next chunk, and is kept. The mapping is of an
+// unmodified file, so released pages are simply read from it again if they are used later.
+static void release_chunk(const obj_chunk_t* chunk) {
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t)chunk->start / page_size * page_size;
+	uintptr_t end = (uintptr_t)chunk->end / page_size * page_size;
+	if (end > start) {
+		madvise((void*)start, end - start, MADV_DONTNEED);
+	}
+}
+
+// Each chunk is parsed into a mesh whose arrays are just large enough for it, and written out before
+// the next is parsed, so the arrays are reused from one chunk to the next.
+int split_obj_file(const char* path, FILE* vertices, FILE* uvs, FILE* faces, obj_counts_t* counts) {
+	mapped_file_t obj;
+	if (!map_file(path, &obj)) {
+		fprintf(stderr, "failed to map %s\n", path);
+		return -1;
+	}
+
+	obj_chunk_t* chunks = split_chunks(obj.data, obj.data + obj.size);
+	int n_chunks = array_len(chunks);
+	obj_counts_t total = { 0 };
+	for (int i = 0; i < n_chunks; i++) {
+		chunks[i].counts = count_lines(chunks[i].start, chunks[i].end);
+		total.vertices += chunks[i].counts.vertices;
+		total.uvs += chunks[i].counts.uvs;
+		total.faces += chunks[i].counts.faces;
+		release_chunk(&chunks[i]);
+	}
+
+	mesh_t mesh = new_mesh();
+	int err = 0;
+	for (int i = 0; i < n_chunks && !err; i++) {
+		obj_counts_t n = chunks[i].counts;
+		mesh.vertices = array_hold(array_reset(mesh.vertices, sizeof(vec3_t)), n.vertices, sizeof(vec3_t));
+		mesh.tex_coords = array_hold(array_reset(mesh.tex_coords, sizeof(tex2_t)), n.uvs, sizeof(tex2_t));
+		mesh.faces = array_hold(array_reset(mesh.faces, sizeof(mesh_face_t)), n.faces, sizeof(mesh_face_t));
+		mesh.face_uvs = array_hold(array_reset(mesh.face_uvs, sizeof(mesh_face_t)), n.faces, sizeof(mesh_face_t));
+		err = parse_lines(chunks[i].start, chunks[i].end, &mesh, (obj_counts_t){ 0 }, total);
+		if (!err && !write_arrays(&mesh, n, vertices, uvs, faces)) {
+			fprintf(stderr, "failed to write the statements of %s\n", path);
+			err = -1;
+		}
+		release_chunk(&chunks[i]);
+	}
+
+	mesh_free(&mesh);
+	array_free(chunks);
+	unmap_file(&obj);
+	*counts = total;
+	return err;
+}
@@ -0,0 +1,41 @@
+// obj.h provides a parser for meshes stored in Wavefront .obj files.
+#ifndef OBJ_H
+#define OBJ_H
+
+#include <stdio.h>
+
+#include "job.h"
+#include "mesh.h"
+
+/*
+Structs
+*/
+
+// obj_counts_t counts the statements of each kind in an .obj file.
+typedef struct obj_counts_t {
+	int vertices;
+	int uvs;
+	int faces;
+} obj_counts_t;
+
+/*
+Functions
+*/
+
+// Parse the vertices, texture coordinates and triangular faces of the .obj file at path into dst,
+// whose arrays must be empty. Faces must give a texture coordinate for each vertex, and may only
+// refer to vertices and texture coordinates in the file. Any other statements are ignored. Large
+// files are split into chunks that are parsed in parallel on the job system. Returns 0 on success or
+// -1 if the file can't be read or is malformed.
+int parse_obj_file(const char* path, mesh_t* dst, job_system_t* jobs);
+
+// Parse the .obj file at path as parse_obj_file does, but write its vertices, tex coords and faces
+// to the given files rather than gathering them into a mesh, so that the memory taken doesn't grow
+// with the size of the file. Vertices are written as vec3_t and tex coords as tex2_t, while each face
+// is written as a mesh_face_t of vertex indices followed by a mesh_face_t of tex coord indices. The
+// file is parsed in order on the calling thread, a chunk at a time. Writes the number of statements
+// of each kind to counts, and returns 0 on success or -1 if the file can't be read or written or is
+// malformed.
+int split_obj_file(const char* path, FILE* vertices, FILE* uvs, FILE* faces, obj_counts_t* counts);
+
+#endif
@@ -0,0 +1,308 @@
+// _DEFAULT_SOURCE exposes madvise and fseeko under -std=c17.
+#define _DEFAULT_SOURCE
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "edge.h"
+#include "must.h"
+#include "partition.h"
+
+// Number of bits per axis of the grid whose cells faces are counted in by their centroids. Chunks are
+// built from runs of consecutive cells along a Z-order curve through the grid.
+#define PARTITION_GRID_BITS 6
+
+#define PARTITION_N_CELLS (1 << (3 * PARTITION_GRID_BITS))
+
+// Total size in bytes of the buffers that faces are gathered in before being written to their chunks.
+#define PARTITION_BUFFER_SIZE (4 << 20)
+
+// Fewest faces buffered for each chunk, however many chunks there are.
+#define PARTITION_MIN_BUFFERED_FACES 16
+
+// Number of faces between releases of the pages of the unsorted faces that have been read.
+#define PARTITION_RELEASE_FACES (1 << 16)
+
+// Appended to the path of an .obj file to name the temporary files it is split into.
+#define PARTITION_TEMP_SUFFIX ".partition.tmp"
+
+// partition_face_t is a face as split_obj_file writes it.
+typedef struct partition_face_t {
+	mesh_face_t vertices;
+	mesh_face_t uvs;
+} partition_face_t;
+
+// open_temp_file opens a temporary file next to the .obj file at path and removes it at once, so that
+// it is deleted however the program exits. Returns NULL if the file can't be opened.
+static FILE* open_temp_file(const char* path) {
+	size_t size = strlen(path) + strlen(PARTITION_TEMP_SUFFIX) + 1;
+	char* temp_path = must_malloc(size);
+	snprintf(temp_path, size, "%s%s", path, PARTITION_TEMP_SUFFIX);
+	FILE* f = fopen(temp_path, "w+b");
+	if (f == NULL) {
+		fprintf(stderr, "failed to open %s in mode w+b\n", temp_path);
+	} else {
+		remove(temp_path);
+	}
+	free(temp_path);
+	return f;
+}
+
+// release_pages releases the pages lying wholly within [start, end) of a mapped file that won't be
+// read again soon. They are simply read from the file again if they are used later.
+static void release_pages(const void* start, const void* end) {
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t first = ((uintptr_t)start + page_size - 1) / page_size * page_size;
+	uintptr_t last = (uintptr_t)end / page_size * page_size;
+	if (last > first) {
+		madvise((void*)first, last - first, MADV_DONTNEED);
+	}
+}
+
+// Spreads the low 10 bits of v so that two zero bits separate each of them.
+static uint32_t spread_bits(uint32_t v) {
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+static uint32_t grid_axis(float v, float min, float scale) {
+	float q = (v - min) * scale;
+	return q <= 0 ? 0 : q >= (1 << PARTITION_GRID_BITS) - 1 ? (1 << PARTITION_GRID_BITS) - 1 : (uint32_t)q;
+}
+
+// face_cell returns the position along the Z-order curve of the cell holding the face's centroid, in
+// a grid over the box from min with scale cells per unit.
+static uint32_t face_cell(const vec3_t* vertices, const mesh_face_t* f, vec3_t min, float scale) {
+	vec3_t a = vertices[f->a];
+	vec3_t b = vertices[f->b];
+	vec3_t c = vertices[f->c];
+	return spread_bits(grid_axis((a.x + b.x + c.x) / 3, min.x, scale)) |
+		spread_bits(grid_axis((a.y + b.y + c.y) / 3, min.y, scale)) << 1 |
+		spread_bits(grid_axis((a.z + b.z + c.z) / 3, min.z, scale)) << 2;
+}
+
+// Writes the n faces buffered for a chunk to the file at the chunk's cursor, counted in faces, and
+// advances the cursor past them.
+static bool flush_faces(FILE* f, const partition_face_t* faces, int n, int* cursor) {
+	bool ok = (
+		fseeko(f, (off_t)*cursor * sizeof(partition_face_t), SEEK_SET) == 0 &&
+		fwrite(faces, sizeof(partition_face_t), n, f) == (size_t)n
+	);
+	*cursor += n;
+	return ok;
+}
+
+// sort_faces writes the unsorted faces to dst grouped by chunk, recording where each chunk begins.
+// Consecutive cells are gathered into a chunk until the next would take it past max_chunk_faces, and
+// the faces of a cell with more than that are divided between chunks of its own in the order they
+// appear. Returns 0 on success or -1 if the faces can't be written.
+static int sort_faces(partition_t* p, const mapped_file_t* unsorted, int max_chunk_faces, FILE* dst) {
+	const vec3_t* vertices = (const vec3_t*)p->vertices.data;
+	const partition_face_t* faces = (const partition_face_t*)unsorted->data;
+	int n_vertices = p->counts.vertices;
+	int n_faces = p->counts.faces;
+
+	vec3_t min = { INFINITY, INFINITY, INFINITY };
+	vec3_t max = { -INFINITY, -INFINITY, -INFINITY };
+	for (int i = 0; i < n_vertices; i++) {
+		vec3_t v = vertices[i];
+		min = (vec3_t){ fminf(min.x, v.x), fminf(min.y, v.y), fminf(min.z, v.z) };
+		max = (vec3_t){ fmaxf(max.x, v.x), fmaxf(max.y, v.y), fmaxf(max.z, v.z) };
+	}
+	release_pages(vertices, vertices + n_vertices);
+	float size = fmaxf(max.x - min.x, fmaxf(max.y - min.y, max.z - min.z));
+	float scale = size > 0 ? (1 << PARTITION_GRID_BITS) / size : 0;
+
+	int* cell_faces = must_calloc(PARTITION_N_CELLS, sizeof(int));
+	for (int i = 0; i < n_faces; i++) {
+		cell_faces[face_cell(vertices, &faces[i].vertices, min, scale)]++;
+		if ((i + 1) % PARTITION_RELEASE_FACES == 0) {
+			release_pages(faces + i + 1 - PARTITION_RELEASE_FACES, faces + i + 1);
+		}
+	}
+
+	int* cell_chunks = must_malloc(sizeof(int) * PARTITION_N_CELLS); // first chunk of each cell
+	int* chunk_sizes = NULL;
+	for (int cell = 0; cell < PARTITION_N_CELLS; cell++) {
+		int n = cell_faces[cell];
+		int n_chunks = array_len(chunk_sizes);
+		if (n > max_chunk_faces) {
+			cell_chunks[cell] = n_chunks;
+			for (; n > 0; n -= max_chunk_faces) {
+				array_push(chunk_sizes, n < max_chunk_faces ? n : max_chunk_faces);
+			}
+		} else if (n_chunks > 0 && chunk_sizes[n_chunks - 1] <= max_chunk_faces - n) {
+			cell_chunks[cell] = n_chunks - 1;
+			chunk_sizes[n_chunks - 1] += n;
+		} else if (n > 0) {
+			cell_chunks[cell] = n_chunks;
+			array_push(chunk_sizes, n);
+		}
+	}
+
+	int n_chunks = array_len(chunk_sizes);
+	p->chunk_faces = array_hold(p->chunk_faces, n_chunks + 1, sizeof(int));
+	int* cursors = must_malloc(sizeof(int) * (n_chunks + 1));
+	p->chunk_faces[0] = 0;
+	for (int i = 0; i < n_chunks; i++) {
+		p->chunk_faces[i + 1] = p->chunk_faces[i] + chunk_sizes[i];
+	}
+	memcpy(cursors, p->chunk_faces, sizeof(int) * (n_chunks + 1));
+
+	// Each chunk's faces are gathered in its own buffer and written out together once it fills, so
+	// that the file is written in runs rather than a face at a time.
+	int n_buffered = PARTITION_BUFFER_SIZE / sizeof(partition_face_t) / (n_chunks > 0 ? n_chunks : 1);
+	n_buffered = n_buffered > PARTITION_MIN_BUFFERED_FACES ? n_buffered : PARTITION_MIN_BUFFERED_FACES;
+	partition_face_t* buffers = must_malloc(sizeof(partition_face_t) * n_buffered * (n_chunks + 1));
+	int* buffer_lens = must_calloc(n_chunks + 1, sizeof(int));
+	memset(cell_faces, 0, sizeof(int) * PARTITION_N_CELLS);
+	bool ok = true;
+	for (int i = 0; i < n_faces && ok; i++) {
+		uint32_t cell = face_cell(vertices, &faces[i].vertices, min, scale);
+		int chunk = cell_chunks[cell] + cell_faces[cell]++ / max_chunk_faces;
+		partition_face_t* buffer = &buffers[chunk * n_buffered];
+		buffer[buffer_lens[chunk]++] = faces[i];
+		if (buffer_lens[chunk] == n_buffered) {
+			ok = flush_faces(dst, buffer, n_buffered, &cursors[chunk]);
+			buffer_lens[chunk] = 0;
+		}
+		if ((i + 1) % PARTITION_RELEASE_FACES == 0) {
+			release_pages(faces + i + 1 - PARTITION_RELEASE_FACES, faces + i + 1);
+		}
+	}
+	for (int i = 0; i < n_chunks && ok; i++) {
+		ok = flush_faces(dst, &buffers[i * n_buffered], buffer_lens[i], &cursors[i]);
+	}
+	release_pages(vertices, vertices + n_vertices);
+
+	free(buffer_lens);
+	free(buffers);
+	free(cursors);
+	array_free(chunk_sizes);
+	free(cell_chunks);
+	free(cell_faces);
+	return ok ? 0 : -1;
+}
+
+int partition_obj_file(const char* path, int max_chunk_faces, partition_t* dst) {
+	*dst = (partition_t){ 0 };
+	FILE* vertices = open_temp_file(path);
+	FILE* uvs = open_temp_file(path);
+	FILE* unsorted_faces = open_temp_file(path);
+	FILE* faces = open_temp_file(path);
+	int err = vertices == NULL || uvs == NULL || unsorted_faces == NULL || faces == NULL ? -1 : 0;
+	if (!err) {
+		err = split_obj_file(path, vertices, uvs, unsorted_faces, &dst->counts);
+	}
+
+	mapped_file_t unsorted = { 0 };
+	if (
+		!err &&
+		!(
+			map_open_file(vertices, &dst->vertices) &&
+			map_open_file(uvs, &dst->uvs) &&
+			map_open_file(unsorted_faces, &unsorted)
+		)
+	) {
+		fprintf(stderr, "failed to map the statements of %s\n", path);
+		err = -1;
+	}
+	if (!err) {
+		err = sort_faces(dst, &unsorted, max_chunk_faces, faces);
+	}
+	if (!err && !map_open_file(faces, &dst->faces)) {
+		err = -1;
+	}
+	if (err) {
+		fprintf(stderr, "failed to partition %s\n", path);
+	}
+
+	unmap_file(&unsorted);
+	FILE* files[] = { vertices, uvs, unsorted_faces, faces };
+	for (int i = 0; i < 4; i++) {
+		if (files[i] != NULL) {
+			fclose(files[i]);
+		}
+	}
+	if (err) {
+		partition_free(dst);
+	}
+	return err;
+}
+
+int partition_n_chunks(const partition_t* p) {
+	return array_len(p->chunk_faces) - 1;
+}
+
+// chunk_vertex returns the index within the chunk of the mesh's vertex i, adding it to the chunk's
+// vertices the first time it is used.
+static uint32_t chunk_vertex(edge_table_t* indices, uint32_t i, const vec3_t* vertices, vec3_t** dst) {
+	int index = edge_table_find(indices, i, 0);
+	if (index < 0) {
+		index = array_len(*dst);
+		edge_table_insert(indices, i, 0, index);
+		array_push(*dst, vertices[i]);
+	}
+	return index;
+}
+
+// chunk_uv returns the index within the chunk of the mesh's tex coord i, adding it to the chunk's tex
+// coords the first time it is used.
+static uint32_t chunk_uv(edge_table_t* indices, uint32_t i, const tex2_t* uvs, tex2_t** dst) {
+	int index = edge_table_find(indices, i, 0);
+	if (index < 0) {
+		index = array_len(*dst);
+		edge_table_insert(indices, i, 0, index);
+		array_push(*dst, uvs[i]);
+	}
+	return index;
+}
+
+void partition_load_chunk(const partition_t* p, int chunk, mesh_t* dst) {
+	const partition_face_t* faces = (const partition_face_t*)p->faces.data;
+	const vec3_t* vertices = (const vec3_t*)p->vertices.data;
+	const tex2_t* uvs = (const tex2_t*)p->uvs.data;
+	int first_face = p->chunk_faces[chunk];
+	int n_faces = p->chunk_faces[chunk + 1] - first_face;
+
+	// Like the vertex indices of an edge, the indices of the mesh are never negative, so each is
+	// paired with 0 to look up its index within the chunk.
+	edge_table_t vertex_indices = new_edge_table(3 * n_faces);
+	edge_table_t uv_indices = new_edge_table(3 * n_faces);
+	dst->faces = array_hold(dst->faces, n_faces, sizeof(mesh_face_t));
+	dst->face_uvs = array_hold(dst->face_uvs, n_faces, sizeof(mesh_face_t));
+	for (int i = 0; i < n_faces; i++) {
+		const partition_face_t* f = &faces[first_face + i];
+		dst->faces[i] = (mesh_face_t){
+			chunk_vertex(&vertex_indices, f->vertices.a, vertices, &dst->vertices),
+			chunk_vertex(&vertex_indices, f->vertices.b, vertices, &dst->vertices),
+			chunk_vertex(&vertex_indices, f->vertices.c, vertices, &dst->vertices),
+		};
+		dst->face_uvs[i] = (mesh_face_t){
+			chunk_uv(&uv_indices, f->uvs.a, uvs, &dst->tex_coords),
+			chunk_uv(&uv_indices, f->uvs.b, uvs, &dst->tex_coords),
+			chunk_uv(&uv_indices, f->uvs.c, uvs, &dst->tex_coords),
+		};
+	}
+	edge_table_free(&uv_indices);
+	edge_table_free(&vertex_indices);
+	release_pages(faces + first_face, faces + first_face + n_faces);
+}
+
+void partition_free(partition_t* p) {
+	unmap_file(&p->vertices);
+	unmap_file(&p->uvs);
+	unmap_file(&p->faces);
+	array_free(p->chunk_faces);
+	*p = (partition_t){ 0 };
+}
@@ -0,0 +1,47 @@
+// partition.h divides meshes too large to hold in memory into spatially coherent chunks, each small
+// enough to be prepared and drawn on its own. The .obj file is parsed a piece at a time into
+// temporary files next to it, which are mapped rather than read, so that the memory partitioning
+// takes doesn't grow with the size of the mesh.
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "file.h"
+#include "mesh.h"
+#include "obj.h"
+
+/*
+Structs
+*/
+
+// partition_t is a mesh divided into chunks, whose faces still refer to the vertices and tex coords of
+// the whole mesh.
+typedef struct partition_t {
+	mapped_file_t vertices; // vec3_t of every vertex of the mesh
+	mapped_file_t uvs; // tex2_t of every tex coord of the mesh
+	mapped_file_t faces; // each face's vertex and tex coord indices, grouped by chunk
+	int* chunk_faces; // dynamic array of the first face of each chunk, followed by the number of faces
+	obj_counts_t counts;
+} partition_t;
+
+/*
+Functions
+*/
+
+// Divide the mesh in the .obj file at path into chunks of at most max_chunk_faces faces, ordered
+// along a Z-order curve through the mesh's bounding box so that each covers a compact region of it.
+// The temporary files are removed as soon as they are opened, so they never outlive the partition.
+// Returns 0 on success or -1 if the file can't be read or is malformed, or if the temporary files
+// can't be written.
+int partition_obj_file(const char* path, int max_chunk_faces, partition_t* dst);
+
+// Returns the number of chunks in the partition.
+int partition_n_chunks(const partition_t* p);
+
+// Gather the faces of the chunk into dst, whose arrays must be empty, along with the vertices and tex
+// coords they use, as parse_obj_file would for an .obj file holding only the chunk.
+void partition_load_chunk(const partition_t* p, int chunk, mesh_t* dst);
+
+// Free the memory associated with the partition, after which it must not be used.
+void partition_free(partition_t* p);
+
+#endif
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#include "must.h"
+#include "partition.h"
+#include "resident.h"
+
+// Most faces in a chunk of a streamed mesh, enough that drawing a chunk amortizes the cost of
+// choosing and requesting its level of detail, but few enough that a chunk is quick to prepare and
+// load.
+#define RESIDENT_CHUNK_FACES 32768
+
+// publish_chunk copies the chunk's entry in the mesh's cache to the mesh, ready to be drawn once the
+// mesh's count of ready chunks covers it.
+static void publish_chunk(resident_mesh_t* mesh, int chunk) {
+	const cache_chunk_t* entry = &mesh->cache.chunks[chunk];
+	resident_chunk_t* dst = &mesh->chunks[chunk];
+	dst->min = entry->min;
+	dst->max = entry->max;
+	dst->n_levels = entry->n_levels;
+	for (int i = 0; i < entry->n_levels; i++) {
+		resident_level_t* level = &dst->levels[i];
+		atomic_init(&level->state, LEVEL_ABSENT);
+		level->last_used = -1;
+		level->size = entry->levels[i].size;
+		level->n_faces = entry->levels[i].n_faces;
+		level->mesh = new_mesh();
+		level->data = NULL;
+	}
+}
+
+// load_requested_level reads the requested level from its mesh's cache, or marks it as failed and
+// gives back the room taken for it if it can't be read.
+static void load_requested_level(resident_set_t* set, resident_request_t request) {
+	resident_mesh_t* mesh = request.mesh;
+	resident_level_t* level = &mesh->chunks[request.chunk].levels[request.level];
+	level->data = chunk_cache_load_level(&mesh->cache, request.chunk, request.level, &level->mesh);
+	if (level->data == NULL) {
+		fprintf(
+			stderr,
+			"failed to load level %d of chunk %d of %s\n",
+			request.level,
+			request.chunk,
+			mesh->path
+		);
+		atomic_fetch_sub(&set->resident_bytes, level->size);
+		atomic_store(&level->state, LEVEL_FAILED);
+		return;
+	}
+	atomic_store(&level->state, LEVEL_RESIDENT);
+}
+
+// serve_requests loads every requested level, newest first since those are the most likely to still
+// be in view. Returns false if the set is stopping.
+static bool serve_requests(resident_set_t* set) {
+	pthread_mutex_lock(&set->mutex);
+	while (!set->is_stopping && array_len(set->requests) > 0) {
+		resident_request_t request = set->requests[array_len(set->requests) - 1];
+		array_pop(set->requests);
+		pthread_mutex_unlock(&set->mutex);
+		load_requested_level(set, request);
+		pthread_mutex_lock(&set->mutex);
+	}
+	bool is_stopping = set->is_stopping;
+	pthread_mutex_unlock(&set->mutex);
+	return !is_stopping;
+}
+
+// build_mesh divides the mesh's .obj file into chunks, preparing each and writing it to the mesh's
+// cache in turn. Each chunk is ready to be drawn as soon as it is written, and only one is held in
+// memory at a time. Requests are served between chunks, so that building doesn't hold up the chunks
+// already built.
+static void build_mesh(resident_set_t* set, resident_mesh_t* mesh) {
+	partition_t partition;
+	if (partition_obj_file(mesh->path, RESIDENT_CHUNK_FACES, &partition) != 0) {
+		return;
+	}
+	int n_chunks = partition_n_chunks(&partition);
+	if (!chunk_cache_create(&mesh->cache, mesh->path, n_chunks)) {
+		partition_free(&partition);
+		return;
+	}
+
+	mesh->chunks = must_calloc(n_chunks > 0 ? n_chunks : 1, sizeof(resident_chunk_t));
+	int n_built = 0;
+	for (; n_built < n_chunks && serve_requests(set); n_built++) {
+		mesh_t chunk = new_mesh();
+		partition_load_chunk(&partition, n_built, &chunk);
+		mesh_prepare_chunk(&chunk);
+		bool is_written = chunk_cache_write_chunk(&mesh->cache, n_built, &chunk);
+		mesh_free(&chunk);
+		if (!is_written) {
+			fprintf(stderr, "failed to write chunk %d of %s\n", n_built, mesh->path);
+			break;
+		}
+		publish_chunk(mesh, n_built);
+		atomic_store_explicit(&mesh->n_chunks, n_built + 1, memory_order_release);
+	}
+	if (n_built == n_chunks) {
+		chunk_cache_finish(&mesh->cache, mesh->path);
+	}
+	partition_free(&partition);
+}
+
+// open_mesh streams the mesh from its chunked cache, building the cache first if there is no usable
+// one.
+static void open_mesh(resident_set_t* set, resident_mesh_t* mesh) {
+	if (!chunk_cache_open(&mesh->cache, mesh->path)) {
+		build_mesh(set, mesh);
+		return;
+	}
+
+	int n_chunks = mesh->cache.n_chunks;
+	mesh->chunks = must_calloc(n_chunks > 0 ? n_chunks : 1, sizeof(resident_chunk_t));
+	for (int i = 0; i < n_chunks; i++) {
+		publish_chunk(mesh, i);
+	}
+	atomic_store_explicit(&mesh->n_chunks, n_chunks, memory_order_release);
+}
+
+// io_thread_main opens the meshes added to the set and loads the levels requested of it until the set
+// is stopped. Requests are served first, since meshes may take a long time to build.
+static void* io_thread_main(void* ctx) {
+	resident_set_t* set = ctx;
+	pthread_mutex_lock(&set->mutex);
+	while (!set->is_stopping) {
+		if (array_len(set->requests) > 0) {
+			pthread_mutex_unlock(&set->mutex);
+			serve_requests(set);
+			pthread_mutex_lock(&set->mutex);
+			continue;
+		}
+		if (array_len(set->pending_meshes) > 0) {
+			resident_mesh_t* mesh = set->pending_meshes[0];
+			memmove(
+				set->pending_meshes,
+				set->pending_meshes + 1,
+				sizeof(resident_mesh_t*) * (array_len(set->pending_meshes) - 1)
+			);
+			array_pop(set->pending_meshes);
+			pthread_mutex_unlock(&set->mutex);
+			open_mesh(set, mesh);
+			pthread_mutex_lock(&set->mutex);
+			continue;
+		}
+		pthread_cond_wait(&set->has_work, &set->mutex);
+	}
+	pthread_mutex_unlock(&set->mutex);
+	return NULL;
+}
+
+resident_set_t* new_resident_set(size_t budget) {
+	resident_set_t* set = must_malloc(sizeof(resident_set_t));
+	*set = (resident_set_t){
+		.meshes = NULL,
+		.budget = budget,
+		.frame = 0,
+		.full_frame = -1,
+		.requests = NULL,
+		.pending_meshes = NULL,
+		.is_stopping = false,
+	};
+	atomic_init(&set->resident_bytes, 0);
+	pthread_mutex_init(&set->mutex, NULL);
+	pthread_cond_init(&set->has_work, NULL);
+	if (pthread_create(&set->io_thread, NULL, io_thread_main, set) != 0) {
+		fprintf(stderr, "failed to start the I/O thread of the resident set\n");
+		abort();
+	}
+	return set;
+}
+
+resident_mesh_t* resident_set_add(resident_set_t* set, const char* path) {
+	resident_mesh_t* mesh = must_malloc(sizeof(resident_mesh_t));
+	*mesh = (resident_mesh_t){
+		.path = must_malloc(strlen(path) + 1),
+		.cache = { .fd = -1 },
+		.chunks = NULL,
+	};
+	strcpy(mesh->path, path);
+	atomic_init(&mesh->n_chunks, 0);
+	array_push(set->meshes, mesh);
+
+	pthread_mutex_lock(&set->mutex);
+	array_push(set->pending_meshes, mesh);
+	pthread_cond_signal(&set->has_work);
+	pthread_mutex_unlock(&set->mutex);
+	return mesh;
+}
+
+int resident_mesh_n_chunks(const resident_mesh_t* mesh) {
+	return atomic_load_explicit(&mesh->n_chunks, memory_order_acquire);
+}
+
+// evict_level frees the resident level.
+static void evict_level(resident_set_t* set, resident_level_t* level) {
+	mesh_free(&level->mesh);
+	level->mesh = new_mesh();
+	free(level->data);
+	level->data = NULL;
+	atomic_store(&level->state, LEVEL_ABSENT);
+	atomic_fetch_sub(&set->resident_bytes, level->size);
+}
+
+// make_room evicts the least recently used levels that weren't used in the current frame until size
+// more bytes fit within the budget. Returns false if they can't be made to fit.
+static bool make_room(resident_set_t* set, size_t size) {
+	while (atomic_load(&set->resident_bytes) + size > set->budget) {
+		// Once nothing more can be evicted, nothing can be until the next frame.
+		if (set->full_frame == set->frame) {
+			return false;
+		}
+
+		resident_level_t* lru = NULL;
+		int n_meshes = array_len(set->meshes);
+		for (int i = 0; i < n_meshes; i++) {
+			const resident_mesh_t* mesh = set->meshes[i];
+			int n_chunks = resident_mesh_n_chunks(mesh);
+			for (int j = 0; j < n_chunks; j++) {
+				resident_chunk_t* chunk = &mesh->chunks[j];
+				for (int k = 0; k < chunk->n_levels; k++) {
+					resident_level_t* level = &chunk->levels[k];
+					if (
+						atomic_load(&level->state) == LEVEL_RESIDENT &&
+						level->last_used < set->frame &&
+						(lru == NULL || level->last_used < lru->last_used)
+					) {
+						lru = level;
+					}
+				}
+			}
+		}
+		if (lru == NULL) {
+			set->full_frame = set->frame;
+			return false;
+		}
+		evict_level(set, lru);
+	}
+	return true;
+}
+
+// request_level marks the level as used in the current frame and, if it is absent and there is room
+// for it, queues it to be loaded.
+static void request_level(resident_set_t* set, resident_mesh_t* mesh, int chunk, int level) {
+	resident_level_t* l = &mesh->chunks[chunk].levels[level];
+	l->last_used = set->frame;
+	// Only this thread queues loads, so the level can't have begun loading since its state was read.
+	if (atomic_load(&l->state) != LEVEL_ABSENT || !make_room(set, l->size)) {
+		return;
+	}
+
+	atomic_store(&l->state, LEVEL_LOADING);
+	atomic_fetch_add(&set->resident_bytes, l->size);
+	pthread_mutex_lock(&set->mutex);
+	array_push(set->requests, ((resident_request_t){ .mesh = mesh, .chunk = chunk, .level = level }));
+	pthread_cond_signal(&set->has_work);
+	pthread_mutex_unlock(&set->mutex);
+}
+
+const mesh_t* resident_set_request(resident_set_t* set, resident_mesh_t* mesh, int chunk, int level) {
+	resident_chunk_t* c = &mesh->chunks[chunk];
+	request_level(set, mesh, chunk, level);
+
+	// Coarser levels are the likeliest to be resident, and the cheapest to draw in the meantime.
+	for (int i = level; i < c->n_levels; i++) {
+		resident_level_t* l = &c->levels[i];
+		if (atomic_load(&l->state) == LEVEL_RESIDENT) {
+			l->last_used = set->frame;
+			return &l->mesh;
+		}
+	}
+	for (int i = level - 1; i >= 0; i--) {
+		resident_level_t* l = &c->levels[i];
+		if (atomic_load(&l->state) == LEVEL_RESIDENT) {
+			l->last_used = set->frame;
+			return &l->mesh;
+		}
+	}
+	return NULL;
+}
+
+void resident_set_end_frame(resident_set_t* set) {
+	set->frame++;
+}
+
+void resident_set_free(resident_set_t* set) {
+	pthread_mutex_lock(&set->mutex);
+	set->is_stopping = true;
+	pthread_cond_signal(&set->has_work);
+	pthread_mutex_unlock(&set->mutex);
+	pthread_join(set->io_thread, NULL);
+
+	// Levels still queued were never loaded, so only resident levels hold memory.
+	int n_meshes = array_len(set->meshes);
+	for (int i = 0; i < n_meshes; i++) {
+		resident_mesh_t* mesh = set->meshes[i];
+		int n_chunks = resident_mesh_n_chunks(mesh);
+		for (int j = 0; j < n_chunks; j++) {
+			resident_chunk_t* chunk = &mesh->chunks[j];
+			for (int k = 0; k < chunk->n_levels; k++) {
+				if (atomic_load(&chunk->levels[k].state) == LEVEL_RESIDENT) {
+					evict_level(set, &chunk->levels[k]);
+				}
+			}
+		}
+		chunk_cache_close(&mesh->cache);
+		free(mesh->chunks);
+		free(mesh->path);
+		free(mesh);
+	}
+	array_free(set->meshes);
+	array_free(set->requests);
+	array_free(set->pending_meshes);
+	pthread_cond_destroy(&set->has_work);
+	pthread_mutex_destroy(&set->mutex);
+	free(set);
+}
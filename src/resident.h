@@ -0,0 +1,116 @@
+// resident.h provides out-of-core streaming of meshes too large to hold in memory. Each mesh is divided
+// into spatially coherent chunks with levels of detail of their own, which are built into a chunked
+// cache a chunk at a time the first time the mesh is loaded. Levels are read from the cache as they
+// come into view and evicted once they haven't been used for a while, so that the memory the meshes
+// take stays within a fixed budget however large they are. All of the building and reading happens
+// on a dedicated I/O thread, so a frame never waits on the disk.
+#ifndef RESIDENT_H
+#define RESIDENT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cache.h"
+#include "mesh.h"
+#include "vector.h"
+
+/*
+Structs
+*/
+
+// resident_level_state_t tracks a level of detail of a chunk through loading and eviction.
+typedef enum resident_level_state_t {
+	LEVEL_ABSENT,
+	LEVEL_LOADING,
+	LEVEL_RESIDENT,
+	LEVEL_FAILED, // the level couldn't be read, and is never requested again
+} resident_level_state_t;
+
+// resident_level_t is a level of detail of a chunk. Its mesh and data belong to the I/O thread while
+// it is loading, and to the frame's thread once it is resident.
+typedef struct resident_level_t {
+	atomic_int state; // one of the resident_level_state_t values
+	long long last_used; // the frame in which the level was last requested
+	size_t size; // number of bytes the level takes once loaded
+	int n_faces;
+	mesh_t mesh; // valid while resident
+	void* data; // memory the mesh's arrays view while resident
+} resident_level_t;
+
+// resident_chunk_t is a compact region of a streamed mesh.
+typedef struct resident_chunk_t {
+	vec3_t min; // bounds of the chunk in model space
+	vec3_t max;
+	int n_levels;
+	resident_level_t levels[CHUNK_CACHE_MAX_LEVELS]; // most detailed first
+} resident_chunk_t;
+
+// resident_mesh_t is a mesh streamed from its chunked cache. Its chunks are ready to be drawn in
+// order as they are built, so that the mesh appears as soon as its first chunk is ready and fills in
+// as the rest arrive.
+typedef struct resident_mesh_t {
+	char* path;
+	chunk_cache_t cache; // used only by the I/O thread
+	resident_chunk_t* chunks; // allocated once the number of chunks is known
+	atomic_int n_chunks; // number of chunks ready to be drawn
+} resident_mesh_t;
+
+// resident_request_t asks the I/O thread to load a level of detail of a chunk.
+typedef struct resident_request_t {
+	resident_mesh_t* mesh;
+	int chunk;
+	int level;
+} resident_request_t;
+
+// resident_set_t tracks the levels of every streamed mesh, loading them on its I/O thread and evicting
+// the least recently used to make room for more once the budget is reached. Apart from freeing it,
+// the set is only used from the thread that draws the frames.
+typedef struct resident_set_t {
+	resident_mesh_t** meshes; // dynamic array
+	size_t budget;
+	atomic_size_t resident_bytes; // bytes of the levels that are resident or loading
+	long long frame;
+	long long full_frame; // the latest frame in which nothing more could be evicted
+	pthread_t io_thread;
+	pthread_mutex_t mutex; // guards the queues and is_stopping
+	pthread_cond_t has_work;
+	resident_request_t* requests; // dynamic array of levels to load, newest last
+	resident_mesh_t** pending_meshes; // dynamic array of meshes to open or build
+	bool is_stopping;
+} resident_set_t;
+
+/*
+Functions
+*/
+
+// Construct an empty resident set that keeps about budget bytes of streamed levels in memory, and
+// start its I/O thread. Aborts if the thread can't be started.
+resident_set_t* new_resident_set(size_t budget);
+
+// Streams the mesh in the .obj file at path, which is opened from its chunked cache or, if it has
+// none, built into one on the I/O thread. Returns at once with the mesh, which has no chunks until
+// the first is ready, and none at all if the file can't be loaded.
+resident_mesh_t* resident_set_add(resident_set_t* set, const char* path);
+
+// Returns the number of the mesh's chunks that are ready to be drawn, which precede the rest.
+int resident_mesh_n_chunks(const resident_mesh_t* mesh);
+
+// Returns the given level of detail of the chunk, which must be ready, if it is resident, or else the
+// nearest resident coarser level or, failing that, the nearest finer one, or NULL if none is. The
+// given level is queued to be loaded if it isn't resident, as long as the least recently used levels
+// not needed in the current frame can be evicted to make room for it. The level returned remains
+// resident until the end of the frame. Levels requested earlier in a frame take priority, so
+// requesting the coarsest level of every chunk in view first ensures that the whole view is drawn
+// before any of it is refined.
+const mesh_t* resident_set_request(resident_set_t* set, resident_mesh_t* mesh, int chunk, int level);
+
+// Begins the next frame, after which the levels used in the current frame may be evicted.
+void resident_set_end_frame(resident_set_t* set);
+
+// Stop the I/O thread once it finishes what it is doing, then free the memory associated with the set
+// and its meshes.
+void resident_set_free(resident_set_t* set);
+
+#endif
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scene.h"
+
+scene_t g_scene = {
+	.meshes = NULL,
+	.textures = NULL,
+	.nodes = NULL,
+	.n_instances = 0,
+};
+
+// mesh_load_t is the context of a job loading a mesh.
+typedef struct mesh_load_t {
+	scene_loads_t* loads;
+	mesh_t* mesh;
+	const char* path;
+	bool build_lods;
+	bool quantize;
+} mesh_load_t;
+
+// texture_load_t is the context of a job loading a texture.
+typedef struct texture_load_t {
+	texture_t* texture;
+	const char* path;
+} texture_load_t;
+
+static void load_mesh_task(void* ctx) {
+	mesh_load_t* load = ctx;
+	int err = load_mesh(load->mesh, load->path, load->build_lods, load->quantize, load->loads->jobs);
+	if (err) {
+		mesh_free(load->mesh);
+		*load->mesh = new_mesh();
+		atomic_fetch_add(&load->loads->n_failed, 1);
+	}
+	free(load);
+}
+
+static void load_texture_task(void* ctx) {
+	texture_load_t* load = ctx;
+	*load->texture = load_png_texture(load->path);
+	free(load);
+}
+
+scene_loads_t new_scene_loads(job_system_t* jobs) {
+	return (scene_loads_t){
+		.jobs = jobs,
+		.pending = { 0 },
+		.n_failed = 0,
+	};
+}
+
+const mesh_t* scene_load_mesh(
+	scene_t* scene,
+	scene_loads_t* loads,
+	const char* path,
+	bool build_lods,
+	bool quantize
+) {
+	mesh_t* mesh = must_malloc(sizeof(mesh_t));
+	*mesh = new_mesh();
+	array_push(scene->meshes, mesh);
+
+	mesh_load_t* load = must_malloc(sizeof(mesh_load_t));
+	*load = (mesh_load_t){
+		.loads = loads,
+		.mesh = mesh,
+		.path = path,
+		.build_lods = build_lods,
+		.quantize = quantize,
+	};
+	job_run(loads->jobs, load_mesh_task, load, &loads->pending);
+	return mesh;
+}
+
+const texture_t* scene_load_texture(scene_t* scene, scene_loads_t* loads, const char* path) {
+	texture_t* texture = must_malloc(sizeof(texture_t));
+	*texture = (texture_t){ 0 };
+	array_push(scene->textures, texture);
+
+	texture_load_t* load = must_malloc(sizeof(texture_load_t));
+	*load = (texture_load_t){ .texture = texture, .path = path };
+	job_run(loads->jobs, load_texture_task, load, &loads->pending);
+	return texture;
+}
+
+int scene_wait_loads(scene_loads_t* loads) {
+	job_wait(loads->jobs, &loads->pending);
+	int n_failed = atomic_load(&loads->n_failed);
+	if (n_failed > 0) {
+		fprintf(stderr, "meshes failed to load: %d\n", n_failed);
+		return -1;
+	}
+	return 0;
+}
+
+int scene_add_node(scene_t* scene, int parent, const mesh_t* mesh, const texture_t* texture) {
+	scene_node_t node = {
+		.parent = parent,
+		.mesh = mesh,
+		.streamed_mesh = NULL,
+		.texture = texture,
+		.rotation = { 0, 0, 0 },
+		.scale = { 1.0, 1.0, 1.0 },
+		.translation = { 0, 0, 0 },
+		.local = mat4_identity(),
+		.world = mat4_identity(),
+		.inverse_world = mat4_identity(),
+		.is_dirty = true,
+		.world_changed = false,
+	};
+	array_push(scene->nodes, node);
+	if (mesh != NULL) {
+		scene->n_instances++;
+	}
+	return array_len(scene->nodes) - 1;
+}
+
+int scene_add_streamed_node(scene_t* scene, int parent, resident_mesh_t* mesh, const texture_t* texture) {
+	int node = scene_add_node(scene, parent, NULL, texture);
+	scene->nodes[node].streamed_mesh = mesh;
+	scene->n_instances++;
+	return node;
+}
+
+static bool vec3_equal(vec3_t a, vec3_t b) {
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+void scene_set_rotation(scene_t* scene, int node, vec3_t rotation) {
+	scene_node_t* n = &scene->nodes[node];
+	if (!vec3_equal(n->rotation, rotation)) {
+		n->rotation = rotation;
+		n->is_dirty = true;
+	}
+}
+
+void scene_set_scale(scene_t* scene, int node, vec3_t scale) {
+	scene_node_t* n = &scene->nodes[node];
+	if (!vec3_equal(n->scale, scale)) {
+		n->scale = scale;
+		n->is_dirty = true;
+	}
+}
+
+void scene_set_translation(scene_t* scene, int node, vec3_t translation) {
+	scene_node_t* n = &scene->nodes[node];
+	if (!vec3_equal(n->translation, translation)) {
+		n->translation = translation;
+		n->is_dirty = true;
+	}
+}
+
+// Returns a matrix representing the scale, position and orientation of the node relative to its
+// parent.
+static mat4_t node_to_parent_matrix(const scene_node_t* node) {
+	mat4_t scale_matrix = mat4_make_scale(node->scale.x, node->scale.y, node->scale.z);
+	mat4_t translation_matrix = mat4_make_translation(
+		node->translation.x,
+		node->translation.y,
+		node->translation.z
+	);
+	mat4_t rotation_matrix_x = mat4_make_rotation_x(node->rotation.x);
+	mat4_t rotation_matrix_y = mat4_make_rotation_y(node->rotation.y);
+	mat4_t rotation_matrix_z = mat4_make_rotation_z(node->rotation.z);
+
+	// Order matters b/c transformations are centred on the origin: scale -> rotate -> translate.
+	mat4_t matrix = mat4_mul(&rotation_matrix_z, &scale_matrix);
+	matrix = mat4_mul(&rotation_matrix_y, &matrix);
+	matrix = mat4_mul(&rotation_matrix_x, &matrix);
+	return mat4_mul(&translation_matrix, &matrix);
+}
+
+// scene_update_transforms relies on parents preceding their children, so that a parent's world
+// matrix, and whether it changed, is settled by the time its children are visited.
+void scene_update_transforms(scene_t* scene) {
+	int n_nodes = array_len(scene->nodes);
+	for (int i = 0; i < n_nodes; i++) {
+		scene_node_t* node = &scene->nodes[i];
+		const scene_node_t* parent = node->parent >= 0 ? &scene->nodes[node->parent] : NULL;
+		node->world_changed = node->is_dirty || (parent != NULL && parent->world_changed);
+		if (!node->world_changed) {
+			continue;
+		}
+
+		if (node->is_dirty) {
+			node->local = node_to_parent_matrix(node);
+			node->is_dirty = false;
+		}
+		node->world = parent != NULL ? mat4_mul(&parent->world, &node->local) : node->local;
+		node->inverse_world = mat4_inverse_affine(&node->world);
+	}
+}
+
+void scene_free(scene_t* scene) {
+	int n_meshes = array_len(scene->meshes);
+	for (int i = 0; i < n_meshes; i++) {
+		mesh_free(scene->meshes[i]);
+		free(scene->meshes[i]);
+	}
+	int n_textures = array_len(scene->textures);
+	for (int i = 0; i < n_textures; i++) {
+		texture_free(scene->textures[i]);
+		free(scene->textures[i]);
+	}
+	array_free(scene->meshes);
+	array_free(scene->textures);
+	array_free(scene->nodes);
+	*scene = (scene_t){ 0 };
+}
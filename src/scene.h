@@ -0,0 +1,110 @@
+// scene.h provides a scene graph of nodes, each of which may place shared mesh and texture data in
+// the world. Nodes are positioned relative to their parents and cache their transforms, which are
+// recomputed only when a node or one of its ancestors moves.
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "job.h"
+#include "mesh.h"
+#include "resident.h"
+#include "texture.h"
+#include "vector.h"
+
+/*
+Structs
+*/
+
+// scene_node_t is a transform relative to the node's parent, optionally carrying an instance of a
+// mesh, which may be streamed. Nodes without a mesh group their children so that they move together.
+// The transform must be changed with the scene_set_* functions so that the cached matrices are kept
+// up to date.
+typedef struct scene_node_t {
+	int parent; // index of the parent in the scene's nodes, always less than the node's, or -1
+	const mesh_t* mesh; // may be NULL
+	resident_mesh_t* streamed_mesh; // may be NULL, and is only set if mesh isn't
+	const texture_t* texture; // may be NULL, in which case the mesh is filled when textured
+	vec3_t rotation;
+	vec3_t scale;
+	vec3_t translation;
+	mat4_t local; // maps the node's space to its parent's
+	mat4_t world; // maps the node's space to world space
+	mat4_t inverse_world; // maps world space to the node's space
+	bool is_dirty; // true if the transform has changed since local was computed
+	bool world_changed; // true if world changed in the latest call to scene_update_transforms
+} scene_node_t;
+
+// scene_t owns the meshes and textures that its nodes share. Each mesh and texture is allocated
+// separately, so nodes' references to them remain valid as more are loaded.
+typedef struct scene_t {
+	mesh_t** meshes; // dynamic array
+	texture_t** textures; // dynamic array
+	scene_node_t* nodes; // dynamic array in which parents precede their children
+	int n_instances; // number of nodes with a mesh or a streamed mesh
+} scene_t;
+
+// scene_loads_t is a batch of meshes and textures being loaded into a scene concurrently on the job
+// system, so that loading takes about as long as the slowest asset rather than the sum of them all.
+// Each asset is handed out as soon as it is queued, so that nodes may refer to it, but must not be
+// read until the batch has been waited for.
+typedef struct scene_loads_t {
+	job_system_t* jobs;
+	job_counter_t pending;
+	atomic_int n_failed; // number of meshes that could not be loaded
+} scene_loads_t;
+
+// Global scene.
+extern scene_t g_scene;
+
+/*
+Functions
+*/
+
+// Construct an empty batch of loads to be run on the job system.
+scene_loads_t new_scene_loads(job_system_t* jobs);
+
+// Queue a mesh to be loaded from the given .obj file into the scene as part of the batch, along with
+// simplified levels of detail if build_lods is set and storing its vertices in 16 bits per component
+// if quantize is set. Returns the mesh it will be loaded into, which is left empty if it cannot be
+// loaded. The path must remain valid until the batch has finished.
+const mesh_t* scene_load_mesh(
+	scene_t* scene,
+	scene_loads_t* loads,
+	const char* path,
+	bool build_lods,
+	bool quantize
+);
+
+// Queue a texture to be loaded from the given .png file into the scene as part of the batch, aborting
+// if it cannot be loaded. Returns the texture it will be loaded into. The path must remain valid until
+// the batch has finished.
+const texture_t* scene_load_texture(scene_t* scene, scene_loads_t* loads, const char* path);
+
+// Wait for every load in the batch to finish, running queued jobs on the calling thread meanwhile.
+// Returns -1 if any mesh could not be loaded.
+int scene_wait_loads(scene_loads_t* loads);
+
+// Adds a node at the origin of its parent, or of the world if parent is -1, returning its index in
+// the scene's nodes. The mesh and texture may be NULL.
+int scene_add_node(scene_t* scene, int parent, const mesh_t* mesh, const texture_t* texture);
+
+// Adds a node drawing the streamed mesh, which is owned by its resident set rather than the scene, as
+// scene_add_node does. The texture may be NULL.
+int scene_add_streamed_node(scene_t* scene, int parent, resident_mesh_t* mesh, const texture_t* texture);
+
+// Setters for the transform of the node at the given index, relative to its parent. Setting a value
+// equal to the current one does not mark the node as changed.
+void scene_set_rotation(scene_t* scene, int node, vec3_t rotation);
+void scene_set_scale(scene_t* scene, int node, vec3_t scale);
+void scene_set_translation(scene_t* scene, int node, vec3_t translation);
+
+// Recompute the cached matrices of every node whose transform has changed, and the world matrices of
+// their descendants, in a single pass over the nodes.
+void scene_update_transforms(scene_t* scene);
+
+// Free the memory associated with the scene and everything it owns, which must not be still loading.
+void scene_free(scene_t* scene);
+
+#endif
@@ -0,0 +1,436 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#include "mesh.h"
+#include "must.h"
+#include "simplify.h"
+
+// Maximum number of passes over the faces. Each pass collapses every edge whose error is below a
+// threshold that grows with the pass number.
+#define SIMPLIFY_MAX_PASSES 100
+
+// Number of passes between compactions of the face list and rebuilds of the vertex-face references.
+#define SIMPLIFY_COMPACT_INTERVAL 5
+
+// Controls how quickly the error threshold grows between passes. Higher values simplify faster at
+// the cost of collapsing edges in a less optimal order.
+#define SIMPLIFY_AGGRESSIVENESS 7
+
+// Minimum cosine of the angle between a face's normal before and after a collapse. Collapses that
+// would turn a face further than this are rejected, since they fold the surface over.
+#define SIMPLIFY_MIN_NORMAL_DOT 0.2
+
+// Faces whose edges at the collapsed vertex would be closer to parallel than this are rejected,
+// since they would become slivers.
+#define SIMPLIFY_MAX_EDGE_DOT 0.999
+
+// quadric_t is a symmetric 4x4 matrix, stored as its upper triangle, that measures the sum of
+// squared distances from a point to a set of planes.
+typedef struct quadric_t {
+	double m[10];
+} quadric_t;
+
+typedef struct simplify_vertex_t {
+	vec3_t p;
+	quadric_t q;
+	int first_ref; // index of the vertex's first reference in the builder's refs
+	int n_refs;
+	bool is_border; // true if the vertex lies on an edge used by only one face
+} simplify_vertex_t;
+
+typedef struct simplify_face_t {
+	int v[3]; // 0-based vertex indices
+	int uv[3]; // 0-based tex coord indices
+	double error[4]; // cost of collapsing each edge, then the least of them
+	vec3_t normal;
+	bool is_deleted;
+	bool is_dirty; // true if the face changed during the current pass
+} simplify_face_t;
+
+// simplify_ref_t refers to the corner of a face that uses a vertex.
+typedef struct simplify_ref_t {
+	int face;
+	int corner;
+} simplify_ref_t;
+
+typedef struct simplifier_t {
+	simplify_vertex_t* vertices;
+	int n_vertices;
+	simplify_face_t* faces;
+	int n_faces;
+	simplify_ref_t* refs; // dynamic array
+} simplifier_t;
+
+static quadric_t new_plane_quadric(double a, double b, double c, double d) {
+	return (quadric_t){ {
+		a * a, a * b, a * c, a * d,
+		b * b, b * c, b * d,
+		c * c, c * d,
+		d * d,
+	} };
+}
+
+static quadric_t quadric_add(const quadric_t* a, const quadric_t* b) {
+	quadric_t sum;
+	for (int i = 0; i < 10; i++) {
+		sum.m[i] = a->m[i] + b->m[i];
+	}
+	return sum;
+}
+
+// Returns the determinant of the 3x3 matrix whose elements are the given entries of the quadric.
+static double quadric_det(
+	const quadric_t* q,
+	int a11, int a12, int a13,
+	int a21, int a22, int a23,
+	int a31, int a32, int a33
+) {
+	const double* m = q->m;
+	return m[a11] * m[a22] * m[a33] + m[a13] * m[a21] * m[a32] + m[a12] * m[a23] * m[a31] -
+		m[a13] * m[a22] * m[a31] - m[a11] * m[a23] * m[a32] - m[a12] * m[a21] * m[a33];
+}
+
+// Returns the sum of squared distances from the point to the quadric's planes.
+static double quadric_error(const quadric_t* q, vec3_t p) {
+	const double* m = q->m;
+	double x = p.x, y = p.y, z = p.z;
+	return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x + m[4] * y * y +
+		2 * m[5] * y * z + 2 * m[6] * y + m[7] * z * z + 2 * m[8] * z + m[9];
+}
+
+// Returns the unit vector in the direction of v, or the zero vector if v has no length.
+static vec3_t safe_normalize(vec3_t v) {
+	float magnitude = vec3_magnitude(&v);
+	return magnitude > 0 ? vec3_sdiv(&v, magnitude) : (vec3_t){ 0, 0, 0 };
+}
+
+// edge_error returns the cost of collapsing the edge between two vertices, writing the position of
+// the merged vertex to p. The merged vertex is placed where the combined quadric is least if that
+// point is unique, or else at whichever of the endpoints and midpoint costs least. Border vertices
+// stay on the border by never taking the former option.
+static double edge_error(const simplifier_t* s, int v1, int v2, vec3_t* p) {
+	const simplify_vertex_t* a = &s->vertices[v1];
+	const simplify_vertex_t* b = &s->vertices[v2];
+	quadric_t q = quadric_add(&a->q, &b->q);
+	double det = quadric_det(&q, 0, 1, 2, 1, 4, 5, 2, 5, 7);
+	if (det != 0 && !a->is_border && !b->is_border) {
+		*p = (vec3_t){
+			.x = -1 / det * quadric_det(&q, 1, 2, 3, 4, 5, 6, 5, 7, 8),
+			.y = 1 / det * quadric_det(&q, 0, 2, 3, 1, 5, 6, 2, 7, 8),
+			.z = -1 / det * quadric_det(&q, 0, 1, 3, 1, 4, 6, 2, 5, 8),
+		};
+		return quadric_error(&q, *p);
+	}
+
+	vec3_t mid = {
+		(a->p.x + b->p.x) / 2,
+		(a->p.y + b->p.y) / 2,
+		(a->p.z + b->p.z) / 2,
+	};
+	double error_a = quadric_error(&q, a->p);
+	double error_b = quadric_error(&q, b->p);
+	double error_mid = quadric_error(&q, mid);
+	double error = fmin(error_a, fmin(error_b, error_mid));
+	*p = error == error_a ? a->p : error == error_b ? b->p : mid;
+	return error;
+}
+
+static void update_face_errors(const simplifier_t* s, simplify_face_t* f) {
+	vec3_t p;
+	for (int j = 0; j < 3; j++) {
+		f->error[j] = edge_error(s, f->v[j], f->v[(j + 1) % 3], &p);
+	}
+	f->error[3] = fmin(f->error[0], fmin(f->error[1], f->error[2]));
+}
+
+// Returns true if moving vertex v1 to p would fold over or degenerate any face that it shares with
+// vertex v0 but not v2. Faces that share both are marked in is_collapsed, since the collapse deletes
+// them.
+static bool collapse_flips(const simplifier_t* s, vec3_t p, int v1, int v2, bool* is_collapsed) {
+	const simplify_vertex_t* v = &s->vertices[v1];
+	for (int k = 0; k < v->n_refs; k++) {
+		simplify_ref_t ref = s->refs[v->first_ref + k];
+		const simplify_face_t* f = &s->faces[ref.face];
+		is_collapsed[k] = false;
+		if (f->is_deleted) {
+			continue;
+		}
+
+		int id1 = f->v[(ref.corner + 1) % 3];
+		int id2 = f->v[(ref.corner + 2) % 3];
+		if (id1 == v2 || id2 == v2) {
+			is_collapsed[k] = true;
+			continue;
+		}
+
+		vec3_t d1 = vec3_sub(&s->vertices[id1].p, &p);
+		d1 = safe_normalize(d1);
+		vec3_t d2 = vec3_sub(&s->vertices[id2].p, &p);
+		d2 = safe_normalize(d2);
+		if (fabsf(vec3_dot(&d1, &d2)) > SIMPLIFY_MAX_EDGE_DOT) {
+			return true;
+		}
+		vec3_t normal = vec3_cross(&d1, &d2);
+		normal = safe_normalize(normal);
+		bool has_normal = f->normal.x != 0 || f->normal.y != 0 || f->normal.z != 0;
+		if (has_normal && vec3_dot(&normal, &f->normal) < SIMPLIFY_MIN_NORMAL_DOT) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Points the faces of vertex v at vertex v0 instead, deleting those marked in is_collapsed, and
+// appends references to the surviving faces to the builder's refs.
+static int retarget_faces(simplifier_t* s, int v0, int v, const bool* is_collapsed) {
+	int n_deleted = 0;
+	const simplify_vertex_t* vertex = &s->vertices[v];
+	for (int k = 0; k < vertex->n_refs; k++) {
+		simplify_ref_t ref = s->refs[vertex->first_ref + k];
+		simplify_face_t* f = &s->faces[ref.face];
+		if (f->is_deleted) {
+			continue;
+		}
+		if (is_collapsed[k]) {
+			f->is_deleted = true;
+			n_deleted++;
+			continue;
+		}
+
+		f->v[ref.corner] = v0;
+		f->is_dirty = true;
+		update_face_errors(s, f);
+		array_push(s->refs, ref);
+	}
+	return n_deleted;
+}
+
+// Removes deleted faces and rebuilds the references from each vertex to the faces that use it.
+static void compact(simplifier_t* s) {
+	int n_faces = 0;
+	for (int i = 0; i < s->n_faces; i++) {
+		if (!s->faces[i].is_deleted) {
+			s->faces[n_faces++] = s->faces[i];
+		}
+	}
+	s->n_faces = n_faces;
+
+	for (int i = 0; i < s->n_vertices; i++) {
+		s->vertices[i].first_ref = 0;
+		s->vertices[i].n_refs = 0;
+	}
+	for (int i = 0; i < s->n_faces; i++) {
+		for (int j = 0; j < 3; j++) {
+			s->vertices[s->faces[i].v[j]].n_refs++;
+		}
+	}
+	int first_ref = 0;
+	for (int i = 0; i < s->n_vertices; i++) {
+		s->vertices[i].first_ref = first_ref;
+		first_ref += s->vertices[i].n_refs;
+		s->vertices[i].n_refs = 0;
+	}
+
+	array_reset(s->refs, sizeof(simplify_ref_t));
+	s->refs = array_hold(s->refs, s->n_faces * 3, sizeof(simplify_ref_t));
+	for (int i = 0; i < s->n_faces; i++) {
+		for (int j = 0; j < 3; j++) {
+			simplify_vertex_t* v = &s->vertices[s->faces[i].v[j]];
+			s->refs[v->first_ref + v->n_refs++] = (simplify_ref_t){ .face = i, .corner = j };
+		}
+	}
+}
+
+// Marks the vertices at either end of every edge that only one face uses. Such vertices outline
+// holes in the surface, which should keep their shape.
+static void mark_borders(simplifier_t* s) {
+	int* neighbours = NULL;
+	int* counts = NULL;
+	for (int i = 0; i < s->n_vertices; i++) {
+		const simplify_vertex_t* v = &s->vertices[i];
+		array_reset(neighbours, sizeof(int));
+		array_reset(counts, sizeof(int));
+		for (int k = 0; k < v->n_refs; k++) {
+			const simplify_face_t* f = &s->faces[s->refs[v->first_ref + k].face];
+			for (int j = 0; j < 3; j++) {
+				int n = 0;
+				int len = array_len(neighbours);
+				while (n < len && neighbours[n] != f->v[j]) {
+					n++;
+				}
+				if (n == len) {
+					array_push(neighbours, f->v[j]);
+					array_push(counts, 1);
+				} else {
+					counts[n]++;
+				}
+			}
+		}
+
+		int len = array_len(neighbours);
+		for (int n = 0; n < len; n++) {
+			if (counts[n] == 1) {
+				s->vertices[neighbours[n]].is_border = true;
+			}
+		}
+	}
+	array_free(neighbours);
+	array_free(counts);
+}
+
+static void init_quadrics(simplifier_t* s) {
+	for (int i = 0; i < s->n_faces; i++) {
+		simplify_face_t* f = &s->faces[i];
+		vec3_t p0 = s->vertices[f->v[0]].p;
+		vec3_t e1 = vec3_sub(&s->vertices[f->v[1]].p, &p0);
+		vec3_t e2 = vec3_sub(&s->vertices[f->v[2]].p, &p0);
+		vec3_t normal = vec3_cross(&e1, &e2);
+		f->normal = safe_normalize(normal);
+		quadric_t q = new_plane_quadric(f->normal.x, f->normal.y, f->normal.z, -vec3_dot(&f->normal, &p0));
+		for (int j = 0; j < 3; j++) {
+			simplify_vertex_t* v = &s->vertices[f->v[j]];
+			v->q = quadric_add(&v->q, &q);
+		}
+	}
+	for (int i = 0; i < s->n_faces; i++) {
+		update_face_errors(s, &s->faces[i]);
+	}
+}
+
+// Writes the remaining faces and the vertices they use to dst.
+static void write_mesh(const simplifier_t* s, const mesh_t* src, mesh_t* dst) {
+	int* new_index = must_malloc(sizeof(int) * s->n_vertices);
+	for (int i = 0; i < s->n_vertices; i++) {
+		new_index[i] = -1;
+	}
+
+	for (int i = 0; i < s->n_faces; i++) {
+		const simplify_face_t* f = &s->faces[i];
+		if (f->is_deleted) {
+			continue;
+		}
+
+		mesh_face_t face;
+		uint32_t* corners[3] = { &face.a, &face.b, &face.c };
+		for (int j = 0; j < 3; j++) {
+			if (new_index[f->v[j]] < 0) {
+				array_push(dst->vertices, s->vertices[f->v[j]].p);
+				new_index[f->v[j]] = array_len(dst->vertices) - 1;
+			}
+			*corners[j] = new_index[f->v[j]];
+		}
+		mesh_face_t uvs = { f->uv[0], f->uv[1], f->uv[2] };
+		array_push(dst->faces, face);
+		array_push(dst->face_uvs, uvs);
+	}
+
+	int n_tex_coords = array_len(src->tex_coords);
+	dst->tex_coords = array_hold(dst->tex_coords, n_tex_coords, sizeof(tex2_t));
+	memcpy(dst->tex_coords, src->tex_coords, sizeof(tex2_t) * n_tex_coords);
+	free(new_index);
+}
+
+// simplify_mesh follows Garland and Heckbert's quadric error metric, but rather than keeping every
+// edge in a priority queue, it makes repeated passes over the faces, collapsing any edge whose error
+// is below a threshold that rises with each pass.
+void simplify_mesh(const mesh_t* src, mesh_t* dst, int target_faces, bool lock_borders) {
+	simplifier_t s = {
+		.n_vertices = array_len(src->vertices),
+		.n_faces = array_len(src->faces),
+		.refs = NULL,
+	};
+	if (s.n_faces == 0) {
+		return;
+	}
+	s.vertices = must_calloc(s.n_vertices, sizeof(simplify_vertex_t));
+	s.faces = must_calloc(s.n_faces, sizeof(simplify_face_t));
+	for (int i = 0; i < s.n_vertices; i++) {
+		s.vertices[i].p = src->vertices[i];
+	}
+	for (int i = 0; i < s.n_faces; i++) {
+		const mesh_face_t* mf = &src->faces[i];
+		const mesh_face_t* uvs = &src->face_uvs[i];
+		s.faces[i] = (simplify_face_t){
+			.v = { mf->a, mf->b, mf->c },
+			.uv = { uvs->a, uvs->b, uvs->c },
+		};
+	}
+
+	compact(&s);
+	mark_borders(&s);
+	init_quadrics(&s);
+
+	bool* is_collapsed0 = NULL;
+	bool* is_collapsed1 = NULL;
+	int n_deleted = 0;
+	int n_faces = s.n_faces;
+	for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && n_faces - n_deleted > target_faces; pass++) {
+		if (pass > 0 && pass % SIMPLIFY_COMPACT_INTERVAL == 0) {
+			compact(&s);
+			n_faces = s.n_faces;
+			n_deleted = 0;
+		}
+		for (int i = 0; i < s.n_faces; i++) {
+			s.faces[i].is_dirty = false;
+		}
+
+		double threshold = 1e-9 * pow(pass + 3, SIMPLIFY_AGGRESSIVENESS);
+		for (int i = 0; i < s.n_faces && n_faces - n_deleted > target_faces; i++) {
+			simplify_face_t* f = &s.faces[i];
+			if (f->is_deleted || f->is_dirty || f->error[3] > threshold) {
+				continue;
+			}
+
+			for (int j = 0; j < 3; j++) {
+				if (f->error[j] > threshold) {
+					continue;
+				}
+				int i0 = f->v[j];
+				int i1 = f->v[(j + 1) % 3];
+				simplify_vertex_t* v0 = &s.vertices[i0];
+				simplify_vertex_t* v1 = &s.vertices[i1];
+				if (v0->is_border != v1->is_border || (lock_borders && v0->is_border)) {
+					continue;
+				}
+
+				vec3_t p;
+				edge_error(&s, i0, i1, &p);
+				array_reset(is_collapsed0, sizeof(bool));
+				is_collapsed0 = array_hold(is_collapsed0, v0->n_refs, sizeof(bool));
+				array_reset(is_collapsed1, sizeof(bool));
+				is_collapsed1 = array_hold(is_collapsed1, v1->n_refs, sizeof(bool));
+				if (collapse_flips(&s, p, i0, i1, is_collapsed0) || collapse_flips(&s, p, i1, i0, is_collapsed1)) {
+					continue;
+				}
+
+				// Merge v1 into v0, then gather references to their surviving faces at the end of
+				// refs, moving them back into v0's original range if they fit.
+				v0->p = p;
+				v0->q = quadric_add(&v0->q, &v1->q);
+				int first_ref = array_len(s.refs);
+				n_deleted += retarget_faces(&s, i0, i0, is_collapsed0);
+				n_deleted += retarget_faces(&s, i0, i1, is_collapsed1);
+				v0 = &s.vertices[i0];
+				int n_refs = array_len(s.refs) - first_ref;
+				if (n_refs <= v0->n_refs) {
+					memmove(&s.refs[v0->first_ref], &s.refs[first_ref], sizeof(simplify_ref_t) * n_refs);
+					array_reset(s.refs, sizeof(simplify_ref_t));
+					s.refs = array_hold(s.refs, first_ref, sizeof(simplify_ref_t));
+				} else {
+					v0->first_ref = first_ref;
+				}
+				v0->n_refs = n_refs;
+				break;
+			}
+		}
+	}
+
+	write_mesh(&s, src, dst);
+	array_free(is_collapsed0);
+	array_free(is_collapsed1);
+	array_free(s.refs);
+	free(s.faces);
+	free(s.vertices);
+}
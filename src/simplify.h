@@ -0,0 +1,22 @@
+// simplify.h provides mesh simplification by quadric error edge collapse, used to build coarser
+// levels of detail for meshes seen from afar.
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <stdbool.h>
+
+struct mesh_t;
+
+/*
+Functions
+*/
+
+// Writes a simplified copy of the freshly parsed mesh src to the empty mesh dst, collapsing the
+// edges whose removal least changes the shape of the surface until at most target_faces faces
+// remain or no edge can be collapsed without folding the surface over. Tex coords are carried over
+// per face corner, and vertices no longer used by any face are dropped. If lock_borders is set,
+// vertices on edges used by only one face are left exactly where they are, so that a mesh cut from a
+// larger one still meets its neighbours once both are simplified.
+void simplify_mesh(const struct mesh_t* src, struct mesh_t* dst, int target_faces, bool lock_borders);
+
+#endif
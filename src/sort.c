@@ -1,77 +1,66 @@
-#include <stdlib.h>
+#include <string.h>
 
 #include "sort.h"
 
-void swap(char* i, char* j, char* temp, size_t obj_size) {
-	memcpy(temp, i, obj_size);
-	memcpy(i, j, obj_size);
-	memcpy(j, temp, obj_size);
-}
-
-char* partition(char* lo, char* hi, size_t obj_size, comparator less) {
-	char* pivot = lo;
-	char* temp = must_malloc(obj_size);
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
 
-	char* i = lo;
-	char* j = hi + obj_size;
-	while (true) {
-		i += obj_size;
-		while (less(i, pivot)) {
-			if (i == hi) {
-				break;
-			}
-			i += obj_size;
-		}
+depth_key_t new_depth_key(float depth, uint32_t index) {
+	return (depth_key_t){
+		.depth = depth_key_quantize(depth),
+		.index = index,
+	};
+}
 
-		j -= obj_size;
-		while (less(pivot, j)) {
-			if (j == lo) {
-				break;
-			}
-			j -= obj_size;
-		}
+uint32_t depth_key_quantize(float depth) {
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	// Negative floats sort in reverse order of their bit patterns, so all their bits are flipped.
+	// Positive floats need only the sign bit set to sort above the negatives.
+	uint32_t mask = (bits & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
+	return bits ^ mask;
+}
 
-		if (i >= j) {
-			break;
+depth_key_t* radix_sort_depth_keys(depth_key_t* keys, depth_key_t* scratch, int len) {
+	// Build the histograms for every pass in a single read of the keys.
+	uint32_t counts[RADIX_PASSES][RADIX_BUCKETS] = { {0} };
+	for (int i = 0; i < len; i++) {
+		uint32_t depth = keys[i].depth;
+		for (int pass = 0; pass < RADIX_PASSES; pass++) {
+			counts[pass][(depth >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
 		}
-
-		swap(i, j, temp, obj_size);
 	}
-	swap(lo, j, temp, obj_size);
-
-	free(temp);
 
-	return j;
-}
+	depth_key_t* src = keys;
+	depth_key_t* dst = scratch;
+	for (int pass = 0; pass < RADIX_PASSES; pass++) {
+		int shift = pass * RADIX_BITS;
+		uint32_t* count = counts[pass];
 
-void qsort_internal(char* lo, char* hi, size_t obj_size, comparator less) {
-	if (lo >= hi) {
-		return;
-	}
+		// Depths that are close together share their high bits, so passes in which every key falls
+		// into the same bucket would leave the order unchanged and are skipped.
+		if (len > 0 && count[(src[0].depth >> shift) & (RADIX_BUCKETS - 1)] == (uint32_t)len) {
+			continue;
+		}
 
-	char* pivot = partition(lo, hi, obj_size, less);
-	qsort_internal(lo, pivot - obj_size, obj_size, less);
-	qsort_internal(pivot + obj_size, hi, obj_size, less);
-}
+		// Convert the counts to the offset at which each bucket starts.
+		uint32_t offset = 0;
+		for (int b = 0; b < RADIX_BUCKETS; b++) {
+			uint32_t n = count[b];
+			count[b] = offset;
+			offset += n;
+		}
 
-// Returns an integer in the range [lo,hi).
-int randIntInRange(int lo, int hi) {
-	return lo + rand() % (hi - lo);
-}
+		for (int i = 0; i < len; i++) {
+			depth_key_t key = src[i];
+			dst[count[(key.depth >> shift) & (RADIX_BUCKETS - 1)]++] = key;
+		}
 
-void shuffle(char* arr, size_t len, size_t obj_size) {
-	char* temp = must_malloc(obj_size);
-	for (int i = 0; i < len; i++) {
-		int swapIdx = randIntInRange(i, len);
-		char* swapPtr = arr + swapIdx * obj_size;
-		swap(arr, swapPtr, temp, obj_size);
+		depth_key_t* temp = src;
+		src = dst;
+		dst = temp;
 	}
-	free(temp);
-}
 
-void quick_sort(void* arr, size_t len, size_t obj_size, comparator less) {
-	char* charr = (char*)arr;
-	char* hi = charr + ((len - 1) * obj_size); // index of the last element
-	shuffle(charr, len, obj_size); // randomize the array to avoid worst-case performance
-	qsort_internal(charr, hi, obj_size, less);
+	return src;
 }
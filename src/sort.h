@@ -1,15 +1,32 @@
+// sort.h provides sorting routines for ordering triangles by depth.
 #ifndef SORT_H
 #define SORT_H
 
-#include <stdbool.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include <stdint.h>
 
-#include "must.h"
+/*
+Structs
+*/
 
-typedef bool(*comparator)(const void*, const void*);
+// depth_key_t pairs the quantized depth of a triangle with the triangle's index in the array of
+// triangles to render, allowing triangles to be ordered without moving them in memory.
+typedef struct depth_key_t {
+	uint32_t depth;
+	uint32_t index;
+} depth_key_t;
 
-void quick_sort(void* arr, size_t len, size_t obj_size, comparator less);
+/*
+Functions
+*/
 
-#endif
\ No newline at end of file
+// Construct a depth key for the triangle at the given index.
+depth_key_t new_depth_key(float depth, uint32_t index);
+
+// Quantizes a float depth to an unsigned integer whose ordering matches that of the float.
+uint32_t depth_key_quantize(float depth);
+
+// Sorts keys by ascending depth using a stable LSB radix sort. scratch must have space for at least
+// len keys. Returns a pointer to whichever of keys and scratch holds the sorted result.
+depth_key_t* radix_sort_depth_keys(depth_key_t* keys, depth_key_t* scratch, int len);
+
+#endif
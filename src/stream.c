@@ -0,0 +1,30 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "must.h"
+#include "stream.h"
+
+int stream_padded_len(int len) {
+	return (len + STREAM_LANES - 1) / STREAM_LANES * STREAM_LANES;
+}
+
+float* stream_alloc(int len) {
+	// Allocate at least one batch so that an empty stream is still a valid, aligned pointer.
+	size_t size = sizeof(float) * (len > 0 ? stream_padded_len(len) : STREAM_LANES);
+	float* stream = must_aligned_alloc(STREAM_ALIGN, size);
+	memset(stream, 0, size);
+	return stream;
+}
+
+uint16_t* stream_alloc_u16(int len) {
+	size_t size = sizeof(uint16_t) * (len > 0 ? stream_padded_len(len) : STREAM_LANES);
+	// aligned_alloc requires the size to be a multiple of the alignment.
+	size = (size + STREAM_ALIGN - 1) / STREAM_ALIGN * STREAM_ALIGN;
+	uint16_t* stream = must_aligned_alloc(STREAM_ALIGN, size);
+	memset(stream, 0, size);
+	return stream;
+}
+
+void stream_free(void* stream) {
+	free(stream);
+}
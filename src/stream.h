@@ -0,0 +1,28 @@
+// stream.h provides arrays of floats laid out for batch processing with SIMD instructions, used to
+// store the components of many vectors as separate streams.
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+
+// Alignment of every stream in bytes, which is the width of the widest SIMD register in use.
+#define STREAM_ALIGN 32
+
+// Number of floats that fit in STREAM_ALIGN bytes. Streams are padded to a multiple of this length so
+// that batches never need a scalar tail.
+#define STREAM_LANES (STREAM_ALIGN / (int)sizeof(float))
+
+// Returns len rounded up to a whole number of lanes.
+int stream_padded_len(int len);
+
+// Allocate a zero-filled stream with space for len floats plus padding, or abort.
+float* stream_alloc(int len);
+
+// Allocate a zero-filled stream with space for len 16-bit integers plus padding, or abort. Every
+// whole number of lanes begins on a 16-byte boundary.
+uint16_t* stream_alloc_u16(int len);
+
+// Free the memory associated with the stream, after which it must not be used.
+void stream_free(void* stream);
+
+#endif
@@ -3,27 +3,29 @@
 
 #include "texture.h"
 
-int g_texture_width = 64;
-int g_texture_height = 64;
-
-color_t* g_mesh_texture = NULL;
-upng_t* png_texture = NULL;
-
-void load_png_texture(const char* filename) {
-	png_texture = upng_new_from_file(filename);
-	if (png_texture == NULL) {
+texture_t load_png_texture(const char* filename) {
+	upng_t* png = upng_new_from_file(filename);
+	if (png == NULL) {
 		fprintf(stderr, "failed to load PNG texture\n");
 		abort();
 	}
 
-	upng_decode(png_texture);
-	upng_error err = upng_get_error(png_texture);
+	upng_decode(png);
+	upng_error err = upng_get_error(png);
 	if (err != UPNG_EOK) {
 		fprintf(stderr, "failed to load PNG texture: code %d\n", err);
 		abort();
 	}
 
-	g_mesh_texture = (color_t*)upng_get_buffer(png_texture);
-	g_texture_width = upng_get_width(png_texture);
-	g_texture_height = upng_get_height(png_texture);
-}
\ No newline at end of file
+	return (texture_t){
+		.pixels = (color_t*)upng_get_buffer(png),
+		.width = upng_get_width(png),
+		.height = upng_get_height(png),
+		.png = png,
+	};
+}
+
+void texture_free(texture_t* t) {
+	upng_free(t->png);
+	*t = (texture_t){ 0 };
+}
@@ -7,16 +7,23 @@
 #include "color.h"
 #include "upng.h"
 
-extern int g_texture_width;
-extern int g_texture_height;
-extern color_t* g_mesh_texture;
-extern upng_t* png_texture;
-
 typedef struct tex2_t {
 	float u;
 	float v;
 } tex2_t;
 
-void load_png_texture(const char* filename);
+// texture_t is a decoded image that can be mapped onto any number of triangles.
+typedef struct texture_t {
+	color_t* pixels; // owned by png
+	int width;
+	int height;
+	upng_t* png;
+} texture_t;
+
+// Load and decode a texture from the given .png file, or abort.
+texture_t load_png_texture(const char* filename);
+
+// Free the memory associated with the texture, after which it must not be used.
+void texture_free(texture_t* t);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,39 +1,90 @@
 #include "triangle.h"
 
+// Largest magnitude of a screen coordinate in pixels that is packed as is. Vertices close to the
+// camera plane may project much farther off screen, and are clamped to stay within the range of the
+// fixed-point coordinates.
+#define PACKED_COORD_LIMIT 67108864.0f
+
 triangle_t new_triangle() {
 	triangle_t t = {
-		.vertices = {0},
-		.tex_coords = {0},
+		.points = {{0}},
+		.inv_w = {0},
+		.tex_coords = {{0}},
+		.texture = NULL,
 		.fill = DEFAULT_FILL_COLOR,
 		.border = DEFAULT_BORDER_COLOR,
-		.avg_depth = 0,
 	};
 	return t;
 }
 
-triangle_t new_triangle_from_face(const face_t* f, const mat4_t* projection) {
-	triangle_t t = new_triangle();
-	t.fill = f->color;
-	t.avg_depth = face_avg_depth(f);
+static int32_t pack_coord(float v) {
+	if (v > PACKED_COORD_LIMIT) {
+		v = PACKED_COORD_LIMIT;
+	} else if (!(v >= -PACKED_COORD_LIMIT)) {
+		v = -PACKED_COORD_LIMIT;
+	}
+	return (int32_t)(v * (1 << TRIANGLE_SUBPIXEL_BITS));
+}
 
+// Integer division truncates toward zero, so unpacking a coordinate truncates it to the same whole
+// pixel as casting the original float would.
+static float unpack_coord(int32_t v) {
+	return v / (1 << TRIANGLE_SUBPIXEL_BITS);
+}
+
+packed_triangle_t new_packed_triangle(const face_t* f, const mesh_face_t* mf, const vertex_cache_t* cache) {
+	uint32_t indices[3] = { mf->a, mf->b, mf->c };
+	packed_triangle_t p = { .fill = f->color };
 	for (int i = 0; i < 3; i++) {
-		t.vertices[i] = mat4_project_vec3(projection, &f->vertices[i]);
-		t.tex_coords[i] = f->tex_coords[i];
+		vec4_t v = vertex_cache_screen(cache, indices[i]);
+		p.x[i] = pack_coord(v.x);
+		p.y[i] = pack_coord(v.y);
+		p.inv_w[i] = 1 / v.w;
 	}
+	return p;
+}
 
+triangle_uv_t new_triangle_uv(const mesh_t* mesh, const mesh_face_t* mf, const texture_t* texture) {
+	return (triangle_uv_t){
+		.tex_coords = {
+			mesh_tex_coord(mesh, mf->a),
+			mesh_tex_coord(mesh, mf->b),
+			mesh_tex_coord(mesh, mf->c),
+		},
+		.texture = texture,
+	};
+}
+
+float triangle_depth(const mesh_face_t* mf, const vertex_cache_t* cache) {
+	return (cache->w[mf->a] + cache->w[mf->b] + cache->w[mf->c]) / 3;
+}
+
+triangle_t triangle_unpack(const packed_triangle_t* p, const triangle_uv_t* uv) {
+	triangle_t t = new_triangle();
+	t.fill = p->fill;
+	for (int i = 0; i < 3; i++) {
+		t.points[i] = (vec2_t){ unpack_coord(p->x[i]), unpack_coord(p->y[i]) };
+		t.inv_w[i] = p->inv_w[i];
+	}
+	if (uv != NULL) {
+		for (int i = 0; i < 3; i++) {
+			t.tex_coords[i] = uv->tex_coords[i];
+		}
+		t.texture = uv->texture;
+	}
 	return t;
 }
 
-const vec4_t* triangle_vertex_a(const triangle_t* t) {
-	return &t->vertices[0];
+const vec2_t* triangle_vertex_a(const triangle_t* t) {
+	return &t->points[0];
 }
 
-const vec4_t* triangle_vertex_b(const triangle_t* t) {
-	return &t->vertices[1];
+const vec2_t* triangle_vertex_b(const triangle_t* t) {
+	return &t->points[1];
 }
 
-const vec4_t* triangle_vertex_c(const triangle_t* t) {
-	return &t->vertices[2];
+const vec2_t* triangle_vertex_c(const triangle_t* t) {
+	return &t->points[2];
 }
 
 tex2_t triangle_tex_a(const triangle_t* t) {
@@ -48,39 +99,14 @@ tex2_t triangle_tex_c(const triangle_t* t) {
 	return t->tex_coords[2];
 }
 
-void triangle_scale_to_screen(triangle_t *t,  int window_width, int window_height) {
-	for (int i = 0; i < 3; i++) {
-		t->vertices[i].x *= window_width / 2.0;
-		t->vertices[i].y *= window_height / 2.0;
-	}
-}
-
-void triangle_translate_to_center(triangle_t* t, int window_width, int window_height) {
-	for (int i = 0; i < 3; i++) {
-		t->vertices[i].x += window_width / 2.0;
-		t->vertices[i].y += window_height / 2.0;
-	}
-}
-
-void triangle_position_on_screen(triangle_t *t, int window_width, int window_height) {
-	triangle_scale_to_screen(t, window_width, window_height);
-	triangle_translate_to_center(t, window_width, window_height);
-}
-
-bool triangle_less_depth(const void* a, const void* b) {
-	triangle_t* ta = (triangle_t*)a;
-	triangle_t* tb = (triangle_t*)b;
-	return ta->avg_depth < tb->avg_depth;
-}
-
 // triangle_is_line returns true if the triangle's points are collinear, including if two or more
 // points are equal.
 bool triangle_is_line(const triangle_t* t) {
-	const vec4_t* a = triangle_vertex_a(t);
-	const vec4_t* b = triangle_vertex_b(t);
-	const vec4_t* c = triangle_vertex_c(t);
-	float m_ab = vec2_gradient((vec2_t){a->x, a->y}, (vec2_t){b->x, b->y});
-	float m_ac = vec2_gradient((vec2_t){a->x, a->y}, (vec2_t){c->x, c->y});
+	const vec2_t* a = triangle_vertex_a(t);
+	const vec2_t* b = triangle_vertex_b(t);
+	const vec2_t* c = triangle_vertex_c(t);
+	float m_ab = vec2_gradient(*a, *b);
+	float m_ac = vec2_gradient(*a, *c);
 	if (
 		m_ab == m_ac || // points are collinear (also tests whether b and c are the same point)
 		(isinf(m_ab) && isinf(m_ac)) || // points are collinear in a vertical line
@@ -96,33 +122,29 @@ bool triangle_is_renderable(const triangle_t* t) {
 	return !triangle_is_line(t);
 }
 
-// Insertion sort a triangle's vertices and their corresponding tex_coords by their y-coordinates.
+// Insertion sort a triangle's vertices and their corresponding inv_w and tex_coords by their
+// y-coordinates.
 void triangle_sort_vertices_by_y(triangle_t* t) {
 	for (int i = 1; i < 3; i++) {
 		int j;
-		vec4_t vert = t->vertices[i];
+		vec2_t point = t->points[i];
+		float inv_w = t->inv_w[i];
 		tex2_t tex = t-> tex_coords[i];
-		for (j = i; j > 0 && vert.y < t->vertices[j-1].y; j--) {
-			t->vertices[j] = t->vertices[j-1];
+		for (j = i; j > 0 && point.y < t->points[j-1].y; j--) {
+			t->points[j] = t->points[j-1];
+			t->inv_w[j] = t->inv_w[j-1];
 			t->tex_coords[j] = t->tex_coords[j-1];
 		}
-		t->vertices[j] = vert;
+		t->points[j] = point;
+		t->inv_w[j] = inv_w;
 		t->tex_coords[j] = tex;
 	}
 }
 
-void triangle_truncate_xy_components(triangle_t* t) {
-	for (int i = 0; i < 3; i++) {
-		vec4_t* v = &t->vertices[i];
-		v->x = (int)v->x;
-		v->y = (int)v->y;
-	}
-}
-
 vec2_t triangle_b_hyp_intercept(const triangle_t* t) {
-	const vec4_t* a = triangle_vertex_a(t);
-	const vec4_t* b = triangle_vertex_b(t);
-	const vec4_t* c = triangle_vertex_c(t);
+	const vec2_t* a = triangle_vertex_a(t);
+	const vec2_t* b = triangle_vertex_b(t);
+	const vec2_t* c = triangle_vertex_c(t);
 	vec2_t intercept = {
 		.x = ((c->x - a->x) * (b->y - a->y) / (c->y - a->y)) + a->x,
 		.y = b->y,
@@ -135,9 +157,9 @@ vec2_t triangle_b_hyp_intercept(const triangle_t* t) {
 // Return the barycentric weights for point p within the given triangle, t.
 vec3_t triangle_barycentric_weights(const triangle_t* t, vec2_t p) {
 	// Find the vectors between each vertex and point p in the plane.
-	vec2_t a = vec2_from_vec4(triangle_vertex_a(t));
-	vec2_t b = vec2_from_vec4(triangle_vertex_b(t));
-	vec2_t c = vec2_from_vec4(triangle_vertex_c(t));
+	vec2_t a = *triangle_vertex_a(t);
+	vec2_t b = *triangle_vertex_b(t);
+	vec2_t c = *triangle_vertex_c(t);
 	vec2_t ac = vec2_sub(c, a);
 	vec2_t ab = vec2_sub(b, a);
 	vec2_t ap = vec2_sub(p, a);
@@ -2,27 +2,52 @@
 #define TRIANGLE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "color.h"
 #include "face.h"
-#include "sort.h"
 #include "texture.h"
 #include "vector.h"
+#include "vertex.h"
+
+/*
+Constants
+*/
+
+// Number of fractional bits in the fixed-point screen coordinates of packed triangles.
+#define TRIANGLE_SUBPIXEL_BITS 4
 
 /*
 Structs
 */
 
+// packed_triangle_t is the compact form in which projected triangles are queued for the raster
+// stage, at less than half the size of a triangle_t. Screen coordinates are fixed point with
+// TRIANGLE_SUBPIXEL_BITS fractional bits, and the reciprocal of each vertex's w is kept for
+// perspective-correct texturing.
+typedef struct packed_triangle_t {
+	int32_t x[3];
+	int32_t y[3];
+	float inv_w[3];
+	color_t fill;
+} packed_triangle_t;
+
+// triangle_uv_t holds the texture mapping of a packed triangle. It is queued alongside the triangle
+// only while a textured render mode is in use.
+typedef struct triangle_uv_t {
+	tex2_t tex_coords[3];
+	const texture_t* texture; // the texture mapped onto the triangle, or NULL
+} triangle_uv_t;
+
 // triangle_t stores three vectors in 2D space that represent the vertices of a projected triangular
-// face.
+// face, unpacked by the raster stage to draw it.
 typedef struct triangle_t {
-	// Depsite being 2D, the triangle's vertices store depth information for perspective-correct
-	// texture mapping.
-	vec4_t vertices[3];
+	vec2_t points[3]; // whole pixels
+	float inv_w[3]; // reciprocal of each vertex's w, for perspective-correct texture mapping
 	tex2_t tex_coords[3];
+	const texture_t* texture; // the texture mapped onto the triangle, or NULL
 	color_t fill;
 	color_t border;
-	float avg_depth;
 } triangle_t;
 
 /*
@@ -32,35 +57,36 @@ Functions
 // Construct a triangle with all fields initialized to sensible defaults.
 triangle_t new_triangle();
 
-// Construct a triangle by projecting a 3D face into 2D space. Preserves the color of the face and
-// calculates avg_depth from the face's vertices.
-triangle_t new_triangle_from_face(const face_t* f, const mat4_t* projection);
+// Construct a packed triangle from a 3D face, taking its vertices from those already projected onto
+// the screen by the vertex cache and preserving the color of the face.
+packed_triangle_t new_packed_triangle(const face_t* f, const mesh_face_t* mf, const vertex_cache_t* cache);
+
+// Construct the texture mapping of the mesh's face, whose texture may be NULL.
+triangle_uv_t new_triangle_uv(const mesh_t* mesh, const mesh_face_t* mf, const texture_t* texture);
+
+// Returns the average view-space depth of the face's vertices, which projection preserves in w.
+float triangle_depth(const mesh_face_t* mf, const vertex_cache_t* cache);
+
+// Unpacks the triangle for drawing, truncating its vertices to whole pixels. uv may be NULL if the
+// triangle is not textured.
+triangle_t triangle_unpack(const packed_triangle_t* p, const triangle_uv_t* uv);
 
 // Getters for named vertices.
-const vec4_t* triangle_vertex_a(const triangle_t* t);
-const vec4_t* triangle_vertex_b(const triangle_t* t);
-const vec4_t* triangle_vertex_c(const triangle_t* t);
+const vec2_t* triangle_vertex_a(const triangle_t* t);
+const vec2_t* triangle_vertex_b(const triangle_t* t);
+const vec2_t* triangle_vertex_c(const triangle_t* t);
 
 // Getters for named texture coordinates.
 tex2_t triangle_tex_a(const triangle_t* t);
 tex2_t triangle_tex_b(const triangle_t* t);
 tex2_t triangle_tex_c(const triangle_t* t);
 
-// Translates and scales the triangle to its final position on-screen.
-void triangle_position_on_screen(triangle_t *t, int window_width, int window_height);
-
-// comparator used for sorting triangles by their average depth.
-bool triangle_less_depth(const void* a, const void* b);
-
 // Returns true if the triangle's dimensions make it possible to render.
 bool triangle_is_renderable(const triangle_t* t);
 
 // Sorts the triangle's vertices by their y-coordinates in-place.
 void triangle_sort_vertices_by_y(triangle_t* t);
 
-// Truncates floating point values in the triangle's position vectors.
-void triangle_truncate_xy_components(triangle_t* t);
-
 /*
 triangle_b_hyp_intercept returns the vector at which a horizontal line projected from
 the triangle's middle vertex (by y-value), b, will intercept the hypotenuse, ac, producing two
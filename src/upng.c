@@ -18,11 +18,16 @@ freely, subject to the following restrictions:
 		distribution.
 */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "upng.h"
 
 #define MAKE_BYTE(b) ((b) & 0xFF)
@@ -41,14 +46,11 @@ freely, subject to the following restrictions:
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
 #define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
 
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
 #define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type */
 
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+#define HUFFMAN_FAST_BITS 10 /* codes of up to this many bits are decoded with a single table lookup */
+#define HUFFMAN_FAST_SIZE (1 << HUFFMAN_FAST_BITS)
+#define HUFFMAN_SYMBOL_BITS 9 /* bits of a fast table entry holding the symbol, above which is the code length */
 
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
@@ -94,11 +96,14 @@ struct upng_t {
 	upng_source		source;
 };
 
-typedef struct huffman_tree {
-	unsigned* tree2d;
-	unsigned maxbitlen;	/*maximum number of bits a single code can get */
-	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
-} huffman_tree;
+/*decoding table of a canonical huffman code. the next HUFFMAN_FAST_BITS bits of input index the fast table, which holds the symbol and length of the code they begin with if it is short enough; longer codes are found by comparing the next MAX_BIT_LENGTH bits against the last code of each length */
+typedef struct huffman_table {
+	uint16_t fast[HUFFMAN_FAST_SIZE];	/*(length << HUFFMAN_SYMBOL_BITS) | symbol, or 0 if the code is too long */
+	unsigned limit[MAX_BIT_LENGTH + 1];	/*one past the last code of each length, left aligned to MAX_BIT_LENGTH bits */
+	uint16_t first_code[MAX_BIT_LENGTH + 1];	/*first code of each length */
+	uint16_t first_index[MAX_BIT_LENGTH + 1];	/*position in symbols of the first code of each length */
+	uint16_t symbols[MAX_SYMBOLS];	/*symbols sorted by code */
+} huffman_table;
 
 static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
 	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
@@ -123,204 +128,224 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
+/* bit reader over a deflate stream. up to 64 bits of input are held ahead of the decoder, so that most symbols are decoded with a single table lookup, and the buffer is refilled a word at a time rather than a bit at a time */
+typedef struct bit_reader {
+	const unsigned char* in;
+	unsigned long size;	/*number of bytes in the stream */
+	unsigned long pos;	/*next byte to be loaded into the buffer */
+	uint64_t buffer;	/*bits not yet consumed, the next of which is the least significant */
+	unsigned count;	/*number of bits in the buffer */
+	unsigned long overrun;	/*number of zero bytes loaded past the end of the stream */
+} bit_reader;
+
+static void bits_init(bit_reader* br, const unsigned char* in, unsigned long size)
+{
+	br->in = in;
+	br->size = size;
+	br->pos = 0;
+	br->buffer = 0;
+	br->count = 0;
+	br->overrun = 0;
+}
 
-static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-	29, 30, 31, 0, 0
-};
+static uint64_t load_le64(const unsigned char* p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+		| ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+/* fill the buffer with at least 56 bits. past the end of the stream zeros are loaded instead, which bits_past_end detects once they are consumed */
+static void bits_refill(bit_reader* br)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
-	return result;
+	if (br->pos + 8 <= br->size) {
+		/* load a whole word, of which the bytes that fit are kept */
+		br->buffer |= load_le64(&br->in[br->pos]) << br->count;
+		br->pos += (63 - br->count) >> 3;
+		br->count |= 56;
+	} else {
+		while (br->count <= 56) {
+			if (br->pos < br->size) {
+				br->buffer |= (uint64_t)br->in[br->pos++] << br->count;
+			} else {
+				br->overrun++;
+			}
+			br->count += 8;
+		}
+	}
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+/* true if more bits have been consumed than the stream holds */
+static int bits_past_end(const bit_reader* br)
 {
-	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
-	return result;
+	return br->overrun * 8 > br->count;
+}
+
+static void bits_consume(bit_reader* br, unsigned nbits)
+{
+	br->buffer >>= nbits;
+	br->count -= nbits;
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+static unsigned read_bits(bit_reader* br, unsigned nbits)
 {
-	tree->tree2d = buffer;
+	unsigned result;
+	if (br->count < nbits) {
+		bits_refill(br);
+	}
+	result = (unsigned)(br->buffer & ((1u << nbits) - 1));
+	bits_consume(br, nbits);
+	return result;
+}
 
-	tree->numcodes = numcodes;
-	tree->maxbitlen = maxbitlen;
+static unsigned reverse_bits(unsigned code, unsigned nbits)
+{
+	unsigned result = 0, i;
+	for (i = 0; i < nbits; i++) {
+		result = (result << 1) | ((code >> i) & 1);
+	}
+	return result;
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+/*given the code lengths (as stored in the PNG file), generate the decoding table of the canonical code defined by Deflate. codes of up to HUFFMAN_FAST_BITS bits fill every entry of the fast table whose low bits they match, so that they are decoded with a single lookup. incomplete codes are allowed, as the spec permits for a single distance code, and decoding an unused code is an error*/
+static void huffman_table_create_lengths(upng_t* upng, huffman_table* table, const unsigned *bitlen, unsigned numcodes)
 {
-	unsigned tree1d[MAX_SYMBOLS];
-	unsigned blcount[MAX_BIT_LENGTH];
-	unsigned nextcode[MAX_BIT_LENGTH+1];
-	unsigned bits, n, i;
-	unsigned nodefilled = 0;	/*up to which node it is filled */
-	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
-
-	/* initialize local vectors */
+	unsigned blcount[MAX_BIT_LENGTH + 1];
+	unsigned nextcode[MAX_BIT_LENGTH + 1];
+	unsigned nextindex[MAX_BIT_LENGTH + 1];
+	unsigned code = 0, index = 0, bits, n;
+
 	memset(blcount, 0, sizeof(blcount));
-	memset(nextcode, 0, sizeof(nextcode));
+	memset(table->fast, 0, sizeof(table->fast));
 
 	/*step 1: count number of instances of each code length */
-	for (bits = 0; bits < tree->numcodes; bits++) {
-		blcount[bitlen[bits]]++;
-	}
-
-	/*step 2: generate the nextcode values */
-	for (bits = 1; bits <= tree->maxbitlen; bits++) {
-		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
+	for (n = 0; n < numcodes; n++) {
+		blcount[bitlen[n]]++;
 	}
 
-	/*step 3: generate all the codes */
-	for (n = 0; n < tree->numcodes; n++) {
-		if (bitlen[n] != 0) {
-			tree1d[n] = nextcode[bitlen[n]]++;
+	/*step 2: find the first code of each length, and the position of its symbol among the symbols sorted by code */
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		nextcode[bits] = code;
+		nextindex[bits] = index;
+		table->first_code[bits] = (uint16_t)code;
+		table->first_index[bits] = (uint16_t)index;
+		code += blcount[bits];
+		/* check if oversubscribed */
+		if (code > (1u << bits)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
+		table->limit[bits] = code << (MAX_BIT_LENGTH - bits);
+		index += blcount[bits];
+		code <<= 1;
 	}
 
-	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
-	}
-
-	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-			/* check if oversubscribed */
-			if (treepos > tree->numcodes - 2) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+	/*step 3: assign the codes in order of symbol, filling the fast table with the short ones */
+	for (n = 0; n < numcodes; n++) {
+		unsigned len = bitlen[n];
+		unsigned entry;
+		if (len == 0) {
+			continue;
+		}
 
-			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-				if (i + 1 == bitlen[n]) {	/*last bit */
-					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-					treepos = 0;
-				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-					nodefilled++;
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-					treepos = nodefilled;
-				}
-			} else {
-				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
-			}
+		table->symbols[nextindex[len]++] = (uint16_t)n;
+		code = nextcode[len]++;
+		if (len > HUFFMAN_FAST_BITS) {
+			continue;
 		}
-	}
 
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		if (tree->tree2d[n] == 32767) {
-			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+		/*the code is read from its most significant bit first, so the fast table is indexed by its bits reversed */
+		entry = (len << HUFFMAN_SYMBOL_BITS) | n;
+		for (index = reverse_bits(code, len); index < HUFFMAN_FAST_SIZE; index += 1u << len) {
+			table->fast[index] = (uint16_t)entry;
 		}
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+static unsigned huffman_decode_symbol(upng_t *upng, bit_reader* br, const huffman_table* table)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	unsigned entry, code, bits;
+	if (br->count < MAX_BIT_LENGTH) {
+		bits_refill(br);
+	}
 
-		bit = read_bit(bp, in);
+	entry = table->fast[br->buffer & (HUFFMAN_FAST_SIZE - 1)];
+	if (entry != 0) {
+		bits_consume(br, entry >> HUFFMAN_SYMBOL_BITS);
+		return entry & ((1u << HUFFMAN_SYMBOL_BITS) - 1);
+	}
 
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
+	/*the code is longer than the fast table covers, so find its length by comparing with the last code of each length */
+	code = reverse_bits((unsigned)(br->buffer & ((1u << MAX_BIT_LENGTH) - 1)), MAX_BIT_LENGTH);
+	for (bits = HUFFMAN_FAST_BITS + 1; bits <= MAX_BIT_LENGTH; bits++) {
+		if (code < table->limit[bits]) {
+			bits_consume(br, bits);
+			return table->symbols[table->first_index[bits] + (code >> (MAX_BIT_LENGTH - bits)) - table->first_code[bits]];
 		}
+	}
 
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
+	/* error: the code is unused */
+	SET_ERROR(upng, UPNG_EMALFORMED);
+	return 0;
+}
+
+/* get the tables of a deflated block with fixed trees */
+static void get_tree_inflate_fixed(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD)
+{
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned n;
+
+	for (n = 0; n < NUM_DEFLATE_CODE_SYMBOLS; n++) {
+		if (n <= 143) {
+			bitlen[n] = 8;
+		} else if (n <= 255) {
+			bitlen[n] = 9;
+		} else if (n <= 279) {
+			bitlen[n] = 7;
+		} else {
+			bitlen[n] = 8;
 		}
 	}
+	for (n = 0; n < NUM_DISTANCE_SYMBOLS; n++) {
+		bitlenD[n] = 5;
+	}
+
+	huffman_table_create_lengths(upng, codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
+	huffman_table_create_lengths(upng, codetreeD, bitlenD, NUM_DISTANCE_SYMBOLS);
 }
 
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD, bit_reader* br)
 {
+	huffman_table codelengthcodetree;
 	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
 	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
 	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
 	unsigned n, hlit, hdist, hclen, i;
 
 	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-	/*C-code note: use no "return" between ctor and dtor of an uivector! */
-	if ((*bp) >> 3 >= inlength - 2) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
-
-	/* clear bitlen arrays */
 	memset(bitlen, 0, sizeof(bitlen));
 	memset(bitlenD, 0, sizeof(bitlenD));
 
-	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	hlit = read_bits(br, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(br, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(br, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
 	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
 		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+			codelengthcode[CLCL[i]] = read_bits(br, 3);
 		} else {
 			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
 		}
 	}
 
-	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
+	/* error: the bit pointer went past the memory */
+	if (bits_past_end(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	huffman_table_create_lengths(upng, &codelengthcodetree, codelengthcode, NUM_CODE_LENGTH_CODES);
 
 	/* bail now if we encountered an error earlier */
 	if (upng->error != UPNG_EOK) {
@@ -330,11 +355,18 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*now we can use this tree to read the lengths for the tree that this function will return */
 	i = 0;
 	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-		unsigned code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+		unsigned code = huffman_decode_symbol(upng, br, &codelengthcodetree);
+		unsigned replength, value;
 		if (upng->error != UPNG_EOK) {
 			break;
 		}
 
+		/* error: the bit pointer went past the memory */
+		if (bits_past_end(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			break;
+		}
+
 		if (code <= 15) {	/*a length code */
 			if (i < hlit) {
 				bitlen[i] = code;
@@ -342,142 +374,113 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 				bitlenD[i - hlit] = code;
 			}
 			i++;
-		} else if (code == 16) {	/*repeat previous */
-			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
-			unsigned value;	/*set value to the previous code */
+			continue;
+		}
 
-			if ((*bp) >> 3 >= inlength) {
+		if (code == 16) {	/*repeat previous */
+			/* error: there is no previous length */
+			if (i == 0) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				break;
 			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
 
+			replength = 3 + read_bits(br, 2);	/*read in the 2 bits that indicate repeat length (3-6) */
 			if ((i - 1) < hlit) {
 				value = bitlen[i - 1];
 			} else {
 				value = bitlenD[i - hlit - 1];
 			}
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = value;
-				} else {
-					bitlenD[i - hlit] = value;
-				}
-				i++;
-			}
 		} else if (code == 17) {	/*repeat "0" 3-10 times */
-			unsigned replength = 3;	/*read in the bits that indicate repeat length */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* error: i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = 0;
-				} else {
-					bitlenD[i - hlit] = 0;
-				}
-				i++;
-			}
-		} else if (code == 18) {	/*repeat "0" 11-138 times */
-			unsigned replength = 11;	/*read in the bits that indicate repeat length */
-			/* error, bit pointer jumps past memory */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
+			replength = 3 + read_bits(br, 3);
+			value = 0;
+		} else {	/*repeat "0" 11-138 times */
+			replength = 11 + read_bits(br, 7);
+			value = 0;
+		}
 
-			replength += read_bits(bp, in, 7);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-				if (i < hlit)
-					bitlen[i] = 0;
-				else
-					bitlenD[i - hlit] = 0;
-				i++;
-			}
-		} else {
-			/* somehow an unexisting code appeared. This can never happen. */
+		/* error: i is larger than the amount of codes */
+		if (i + replength > hlit + hdist) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			break;
 		}
+
+		/*repeat this value in the next lengths */
+		for (n = 0; n < replength; n++) {
+			if (i < hlit) {
+				bitlen[i] = value;
+			} else {
+				bitlenD[i - hlit] = value;
+			}
+			i++;
+		}
 	}
 
+	/*the length of the end code 256 must be larger than 0 */
 	if (upng->error == UPNG_EOK && bitlen[256] == 0) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 	}
 
-	/*the length of the end code 256 must be larger than 0 */
 	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetree, bitlen);
+		huffman_table_create_lengths(upng, codetree, bitlen, NUM_DEFLATE_CODE_SYMBOLS);
 	}
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+		huffman_table_create_lengths(upng, codetreeD, bitlenD, NUM_DISTANCE_SYMBOLS);
 	}
 }
 
-/*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+/* copy length bytes from distance bytes back in out. when the distance is at least a word, every word is read after it has been written, so the copy proceeds a word at a time, spilling up to 7 bytes past the end of the match that later output overwrites */
+static void copy_match(unsigned char* out, unsigned long outsize, unsigned long pos, unsigned long distance, unsigned long length)
 {
-	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
-	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
-	unsigned done = 0;
+	unsigned char* dst = &out[pos];
+	const unsigned char* src = dst - distance;
+	const unsigned char* end = dst + length;
+
+	if (distance >= 8 && outsize - pos >= length + 7) {
+		do {
+			memcpy(dst, src, 8);
+			dst += 8;
+			src += 8;
+		} while (dst < end);
+	} else if (distance == 1) {
+		memset(dst, *src, length);
+	} else {
+		while (dst < end) {
+			*dst++ = *src++;
+		}
+	}
+}
 
-	huffman_tree codetree;
-	huffman_tree codetreeD;
+/*inflate a block with dynamic of fixed Huffman tree*/
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos, unsigned btype)
+{
+	huffman_table codetree;
+	huffman_table codetreeD;
 
 	if (btype == 1) {
-		/* fixed trees */
-		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-	} else if (btype == 2) {
-		/* dynamic trees */
-		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-		huffman_tree codelengthcodetree;
-
-		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+		get_tree_inflate_fixed(upng, &codetree, &codetreeD);
+	} else {
+		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, br);
+	}
+	if (upng->error != UPNG_EOK) {
+		return;
 	}
 
-	while (done == 0) {
-		unsigned code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+	for (;;) {
+		unsigned code = huffman_decode_symbol(upng, br, &codetree);
+		unsigned long length, distance;
+		unsigned codeD;
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
 
-		if (code == 256) {
-			/* end code */
-			done = 1;
-		} else if (code <= 255) {
+		/* error: end of input memory reached without endcode */
+		if (bits_past_end(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
+
+		if (code <= 255) {
 			/* literal symbol */
 			if ((*pos) >= outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
@@ -486,88 +489,78 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 
 			/* store output */
 			out[(*pos)++] = (unsigned char)(code);
-		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
-			/* part 1: get length base */
-			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
-			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
-
-			/* part 2: get extra bits and add the value of that to length */
-			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
-
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-			length += read_bits(bp, in, numextrabits);
-
-			/*part 3: get distance code */
-			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
-			if (upng->error != UPNG_EOK) {
-				return;
-			}
-
-			/* invalid distance code (30-31 are never used) */
-			if (codeD > 29) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-
-			distance = DISTANCE_BASE[codeD];
+			continue;
+		}
 
-			/*part 4: get extra bits from distance */
-			numextrabitsD = DISTANCE_EXTRA[codeD];
+		if (code == 256) {
+			/* end code */
+			return;
+		}
 
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+		/* invalid length code (286-287 are never used) */
+		if (code > LAST_LENGTH_CODE_INDEX) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 
-			distance += read_bits(bp, in, numextrabitsD);
+		/* get the length and its extra bits */
+		length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
+		length += read_bits(br, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
 
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
+		/* get distance code */
+		codeD = huffman_decode_symbol(upng, br, &codetreeD);
+		if (upng->error != UPNG_EOK) {
+			return;
+		}
 
-			if ((*pos) + length >= outsize) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+		/* invalid distance code (30-31 are never used) */
+		if (codeD > 29) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 
-			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
+		/* get the distance and its extra bits */
+		distance = DISTANCE_BASE[codeD];
+		distance += read_bits(br, DISTANCE_EXTRA[codeD]);
 
-				if (backward >= start) {
-					backward = start - distance;
-				}
-			}
+		/* error: the match reaches before the start or past the end of the output */
+		if (distance > (*pos) || length > outsize - (*pos)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
+
+		copy_match(out, outsize, *pos, distance, length);
+		(*pos) += length;
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos)
 {
 	unsigned long p;
-	unsigned len, nlen, n;
+	unsigned len, nlen;
 
 	/* go to first boundary of byte */
-	while (((*bp) & 0x7) != 0) {
-		(*bp)++;
+	bits_consume(br, br->count & 7);
+	if (bits_past_end(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
 	}
-	p = (*bp) / 8;		/*byte position */
+
+	/* the whole bytes left in the buffer are returned to the stream, which is read directly */
+	p = br->pos + br->overrun - br->count / 8;	/*byte position */
+	br->buffer = 0;
+	br->count = 0;
+	br->overrun = 0;
 
 	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
+	if (p + 4 > br->size) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
+	len = br->in[p] + 256 * br->in[p + 1];
 	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
+	nlen = br->in[p] + 256 * br->in[p + 1];
 	p += 2;
 
 	/* check if 16-bit nlen is really the one's complement of len */
@@ -576,53 +569,52 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
+	if (len > outsize - (*pos)) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
 	/* read the literal data: len bytes are now stored in the out buffer */
-	if (p + len > inlength) {
+	if (len > br->size - p) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
-	}
-
-	(*bp) = p * 8;
+	memcpy(&out[*pos], &br->in[p], len);
+	(*pos) += len;
+	br->pos = p + len;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
 static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
 {
-	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
+	bit_reader br;	/*reads the "in" data from the lsb to the msb of each byte */
 	unsigned long pos = 0;	/*byte position in the out buffer */
 
 	unsigned done = 0;
 
+	bits_init(&br, &in[inpos], insize - inpos);
 	while (done == 0) {
 		unsigned btype;
 
-		/* ensure next bit doesn't point past the end of the buffer */
-		if ((bp >> 3) >= insize) {
+		/* read block control bits */
+		done = read_bits(&br, 1);
+		btype = read_bits(&br, 2);
+
+		/* ensure the bits read don't point past the end of the buffer */
+		if (bits_past_end(&br)) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		}
 
-		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
-
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, out, outsize, &br, &pos);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, out, outsize, &br, &pos, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -682,6 +674,139 @@ static int paeth_predictor(int a, int b, int c)
 		return c;
 }
 
+#if defined(__SSE2__)
+/* SSE2 unfilter kernels. Up adds the previous scanline 16 bytes at a time whatever the pixel size. Sub, Average and Paeth depend on the pixel to the left, so for 3 and 4 byte pixels they work a whole pixel at a time instead of a byte at a time. the pixel size is passed as a constant so that the loads and stores of each are specialized */
+
+/* load a pixel into the low lanes, room being the number of bytes left in the row. 3 byte pixels are loaded as a whole word where there is room, since assembling the word a byte at a time stalls; the lanes of a pixel never mix with the fourth, so what it holds doesn't matter */
+static __m128i load_pixel(const unsigned char* p, unsigned long bytewidth, unsigned long room)
+{
+	int32_t v = 0;
+	if (room >= 4) {
+		memcpy(&v, p, 4);
+	} else {
+		memcpy(&v, p, bytewidth);
+	}
+	return _mm_cvtsi32_si128(v);
+}
+
+static void store_pixel(unsigned char* p, __m128i v, unsigned long bytewidth)
+{
+	int32_t x = _mm_cvtsi128_si32(v);
+	memcpy(p, &x, bytewidth);
+}
+
+static void unfilter_up_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i;
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+		__m128i b = _mm_loadu_si128((const __m128i*)&precon[i]);
+		_mm_storeu_si128((__m128i*)&recon[i], _mm_add_epi8(x, b));
+	}
+	for (; i < length; i++) {
+		recon[i] = scanline[i] + precon[i];
+	}
+}
+
+static inline void unfilter_sub_sse2(unsigned char *recon, const unsigned char *scanline, unsigned long bytewidth, unsigned long length)
+{
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+	for (i = 0; i < length; i += bytewidth) {
+		a = _mm_add_epi8(a, load_pixel(&scanline[i], bytewidth, length - i));
+		store_pixel(&recon[i], a, bytewidth);
+	}
+}
+
+static inline void unfilter_average_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+	for (i = 0; i < length; i += bytewidth) {
+		__m128i b = load_pixel(&precon[i], bytewidth, length - i);
+		/* _mm_avg_epu8 rounds up, where the filter rounds down */
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(average, load_pixel(&scanline[i], bytewidth, length - i));
+		store_pixel(&recon[i], a, bytewidth);
+	}
+}
+
+static __m128i abs_epi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i select_si128(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* the Paeth predictor of paeth_predictor, branch free in 16 bit lanes. p - a, p - b and p - c reduce to b - c, a - c and their sum, which can't overflow */
+static inline void unfilter_paeth_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = zero, c = zero;
+	unsigned long i;
+	for (i = 0; i < length; i += bytewidth) {
+		__m128i b = _mm_unpacklo_epi8(load_pixel(&precon[i], bytewidth, length - i), zero);
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = abs_epi16(_mm_add_epi16(pa, pb));
+		__m128i smallest, predictor, d;
+		pa = abs_epi16(pa);
+		pb = abs_epi16(pb);
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		predictor = select_si128(_mm_cmpeq_epi16(smallest, pa), a, select_si128(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		d = _mm_add_epi8(_mm_packus_epi16(predictor, predictor), load_pixel(&scanline[i], bytewidth, length - i));
+		store_pixel(&recon[i], d, bytewidth);
+		a = _mm_unpacklo_epi8(d, zero);
+		c = b;
+	}
+}
+
+/* unfilter the scanline with the kernel for its filter type and pixel size, returning 0 if there is none */
+static int unfilter_scanline_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+{
+	if (filterType == 2 && precon) {
+		unfilter_up_sse2(recon, scanline, precon, length);
+		return 1;
+	}
+
+	if ((bytewidth != 3 && bytewidth != 4) || length % bytewidth != 0) {
+		return 0;
+	}
+
+	switch (filterType) {
+	case 1:
+		if (bytewidth == 3)
+			unfilter_sub_sse2(recon, scanline, 3, length);
+		else
+			unfilter_sub_sse2(recon, scanline, 4, length);
+		return 1;
+	case 3:
+		if (!precon)
+			return 0;
+		if (bytewidth == 3)
+			unfilter_average_sse2(recon, scanline, precon, 3, length);
+		else
+			unfilter_average_sse2(recon, scanline, precon, 4, length);
+		return 1;
+	case 4:
+		if (!precon)
+			return 0;
+		if (bytewidth == 3)
+			unfilter_paeth_sse2(recon, scanline, precon, 3, length);
+		else
+			unfilter_paeth_sse2(recon, scanline, precon, 4, length);
+		return 1;
+	default:
+		return 0;
+	}
+}
+#endif
+
 static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
 {
 	/*
@@ -693,6 +818,12 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	 */
 
 	unsigned long i;
+#if defined(__SSE2__)
+	if (unfilter_scanline_sse2(recon, scanline, precon, bytewidth, filterType, length)) {
+		return;
+	}
+#endif
+
 	switch (filterType) {
 	case 0:
 		for (i = 0; i < length; i++)
@@ -337,4 +337,32 @@ vec4_t mat4_project_vec3(const mat4_t* m, const vec3_t* v) {
 		projected.z /= projected.w;
 	}
 	return projected;
-}
\ No newline at end of file
+}
+
+// mat4_inverse_affine inverts a matrix whose bottom row is (0, 0, 0, 1), such as any combination of
+// scale, rotation and translation, by inverting its upper 3x3 block with the adjugate and applying
+// the inverse to the negated translation.
+mat4_t mat4_inverse_affine(const mat4_t* m) {
+	const float (*a)[4] = m->m;
+	float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+	float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+	float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+	float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+	float inv_det = 1 / det;
+
+	mat4_t inv = mat4_identity();
+	inv.m[0][0] = c00 * inv_det;
+	inv.m[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv_det;
+	inv.m[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv_det;
+	inv.m[1][0] = c01 * inv_det;
+	inv.m[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv_det;
+	inv.m[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv_det;
+	inv.m[2][0] = c02 * inv_det;
+	inv.m[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv_det;
+	inv.m[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv_det;
+
+	for (int i = 0; i < 3; i++) {
+		inv.m[i][3] = -(inv.m[i][0] * a[0][3] + inv.m[i][1] * a[1][3] + inv.m[i][2] * a[2][3]);
+	}
+	return inv;
+}
@@ -66,5 +66,6 @@ vec4_t mat4_mul_vec4(const mat4_t* m, const vec4_t* v);
 mat4_t mat4_mul(const mat4_t* a, const mat4_t* b);
 mat4_t mat4_make_perspective(float fov, float aspect, float znear, float zfar);
 vec4_t mat4_project_vec3(const mat4_t* m, const vec3_t* v);
+mat4_t mat4_inverse_affine(const mat4_t* m);
 
 #endif
\ No newline at end of file
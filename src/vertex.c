@@ -0,0 +1,202 @@
+#include "stream.h"
+#include "vertex.h"
+
+// The kernels below are written against a batch_t of as many floats as the widest available SIMD
+// register holds, falling back to one float at a time where neither AVX nor SSE2 is available.
+// batch_load_u16 widens a batch of 16-bit integers to floats.
+#if defined(__AVX__)
+#include <immintrin.h>
+typedef __m256 batch_t;
+#define BATCH_LANES 8
+#define batch_load(p) _mm256_load_ps(p)
+#define batch_load_u16(p) _mm256_cvtepi32_ps(_mm256_set_m128i( \
+	_mm_unpackhi_epi16(_mm_load_si128((const __m128i*)(p)), _mm_setzero_si128()), \
+	_mm_unpacklo_epi16(_mm_load_si128((const __m128i*)(p)), _mm_setzero_si128()) \
+))
+#define batch_store(p, v) _mm256_store_ps((p), (v))
+#define batch_splat(s) _mm256_set1_ps(s)
+#define batch_add(a, b) _mm256_add_ps((a), (b))
+#define batch_mul(a, b) _mm256_mul_ps((a), (b))
+#define batch_div(a, b) _mm256_div_ps((a), (b))
+#define batch_zero_to_one(v) \
+	_mm256_blendv_ps((v), _mm256_set1_ps(1), _mm256_cmp_ps((v), _mm256_setzero_ps(), _CMP_EQ_OQ))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 batch_t;
+#define BATCH_LANES 4
+#define batch_load(p) _mm_load_ps(p)
+#define batch_load_u16(p) \
+	_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(p)), _mm_setzero_si128()))
+#define batch_store(p, v) _mm_store_ps((p), (v))
+#define batch_splat(s) _mm_set1_ps(s)
+#define batch_add(a, b) _mm_add_ps((a), (b))
+#define batch_mul(a, b) _mm_mul_ps((a), (b))
+#define batch_div(a, b) _mm_div_ps((a), (b))
+#define batch_zero_to_one(v) _mm_or_ps( \
+	_mm_and_ps(_mm_cmpeq_ps((v), _mm_setzero_ps()), _mm_set1_ps(1)), \
+	_mm_andnot_ps(_mm_cmpeq_ps((v), _mm_setzero_ps()), (v)) \
+)
+#else
+typedef float batch_t;
+#define BATCH_LANES 1
+#define batch_load(p) (*(p))
+#define batch_load_u16(p) ((float)*(p))
+#define batch_store(p, v) (*(p) = (v))
+#define batch_splat(s) (s)
+#define batch_add(a, b) ((a) + (b))
+#define batch_mul(a, b) ((a) * (b))
+#define batch_div(a, b) ((a) / (b))
+#define batch_zero_to_one(v) ((v) == 0 ? 1.0f : (v))
+#endif
+
+// Returns row r of the matrix, whose elements have been splatted across batches, multiplied by a
+// batch of vectors (x, y, z, 1).
+static batch_t batch_transform_row(const batch_t m[4][4], int r, batch_t x, batch_t y, batch_t z) {
+	batch_t sum = batch_add(batch_mul(m[r][0], x), batch_mul(m[r][1], y));
+	sum = batch_add(sum, batch_mul(m[r][2], z));
+	return batch_add(sum, m[r][3]);
+}
+
+static void splat_matrix(const mat4_t* matrix, batch_t m[4][4]) {
+	for (int r = 0; r < 4; r++) {
+		for (int c = 0; c < 4; c++) {
+			m[r][c] = batch_splat(matrix->m[r][c]);
+		}
+	}
+}
+
+// transform_streams multiplies each vector (x, y, z, 1) by the matrix, writing each component of the
+// results to its own stream. len must be a multiple of STREAM_LANES.
+static void transform_streams(
+	const mat4_t* matrix,
+	const float* x,
+	const float* y,
+	const float* z,
+	float* out_x,
+	float* out_y,
+	float* out_z,
+	float* out_w,
+	int len
+) {
+	batch_t m[4][4];
+	splat_matrix(matrix, m);
+	for (int i = 0; i < len; i += BATCH_LANES) {
+		batch_t vx = batch_load(x + i);
+		batch_t vy = batch_load(y + i);
+		batch_t vz = batch_load(z + i);
+		batch_store(out_x + i, batch_transform_row(m, 0, vx, vy, vz));
+		batch_store(out_y + i, batch_transform_row(m, 1, vx, vy, vz));
+		batch_store(out_z + i, batch_transform_row(m, 2, vx, vy, vz));
+		batch_store(out_w + i, batch_transform_row(m, 3, vx, vy, vz));
+	}
+}
+
+// transform_quantized_streams is transform_streams for streams of 16-bit integers, which are widened
+// to floats as they are loaded. Dequantizing them is left to the matrix.
+static void transform_quantized_streams(
+	const mat4_t* matrix,
+	const uint16_t* x,
+	const uint16_t* y,
+	const uint16_t* z,
+	float* out_x,
+	float* out_y,
+	float* out_z,
+	float* out_w,
+	int len
+) {
+	batch_t m[4][4];
+	splat_matrix(matrix, m);
+	for (int i = 0; i < len; i += BATCH_LANES) {
+		batch_t vx = batch_load_u16(x + i);
+		batch_t vy = batch_load_u16(y + i);
+		batch_t vz = batch_load_u16(z + i);
+		batch_store(out_x + i, batch_transform_row(m, 0, vx, vy, vz));
+		batch_store(out_y + i, batch_transform_row(m, 1, vx, vy, vz));
+		batch_store(out_z + i, batch_transform_row(m, 2, vx, vy, vz));
+		batch_store(out_w + i, batch_transform_row(m, 3, vx, vy, vz));
+	}
+}
+
+// project_streams performs the perspective divide on clip-space streams in place, leaving w intact,
+// then scales and translates x and y from normalized device coordinates to the window. Vertices with
+// w == 0 are not divided. len must be a multiple of STREAM_LANES.
+static void project_streams(float* x, float* y, float* z, const float* w, int len, float half_width, float half_height) {
+	batch_t hw = batch_splat(half_width);
+	batch_t hh = batch_splat(half_height);
+	for (int i = 0; i < len; i += BATCH_LANES) {
+		batch_t vw = batch_load(w + i);
+		batch_t divisor = batch_zero_to_one(vw);
+		batch_t px = batch_div(batch_load(x + i), divisor);
+		batch_t py = batch_div(batch_load(y + i), divisor);
+		batch_store(x + i, batch_add(batch_mul(px, hw), hw));
+		batch_store(y + i, batch_add(batch_mul(py, hh), hh));
+		batch_store(z + i, batch_div(batch_load(z + i), divisor));
+	}
+}
+
+// Cached values are discarded every frame, so the streams are replaced rather than copied when they
+// grow.
+void vertex_cache_hold(vertex_cache_t* cache, int len) {
+	if (cache->x != NULL && len <= cache->capacity) {
+		return;
+	}
+
+	vertex_cache_free(cache);
+	cache->x = stream_alloc(len);
+	cache->y = stream_alloc(len);
+	cache->z = stream_alloc(len);
+	cache->w = stream_alloc(len);
+	cache->capacity = len;
+}
+
+void vertex_cache_update(
+	vertex_cache_t* cache,
+	const mesh_t* mesh,
+	const int* clusters,
+	int n_clusters,
+	const mat4_t* matrix,
+	int window_width,
+	int window_height
+) {
+	const mesh_positions_t* p = &mesh->positions;
+	// Each cluster's vertices start on a lane boundary and are followed by padding up to the next, so
+	// every cluster is transformed in whole, aligned batches.
+	for (int i = 0; i < n_clusters; i++) {
+		const cluster_t* c = &mesh->clusters[clusters[i]];
+		int first = c->first_vertex;
+		int len = stream_padded_len(c->n_vertices);
+		if (mesh->is_quantized) {
+			transform_quantized_streams(
+				matrix,
+				p->qx + first, p->qy + first, p->qz + first,
+				cache->x + first, cache->y + first, cache->z + first, cache->w + first,
+				len
+			);
+		} else {
+			transform_streams(
+				matrix,
+				p->x + first, p->y + first, p->z + first,
+				cache->x + first, cache->y + first, cache->z + first, cache->w + first,
+				len
+			);
+		}
+		project_streams(
+			cache->x + first, cache->y + first, cache->z + first, cache->w + first,
+			len,
+			window_width / 2.0,
+			window_height / 2.0
+		);
+	}
+}
+
+vec4_t vertex_cache_screen(const vertex_cache_t* cache, int i) {
+	return (vec4_t){ cache->x[i], cache->y[i], cache->z[i], cache->w[i] };
+}
+
+void vertex_cache_free(vertex_cache_t* cache) {
+	stream_free(cache->x);
+	stream_free(cache->y);
+	stream_free(cache->z);
+	stream_free(cache->w);
+	*cache = (vertex_cache_t){ 0 };
+}
@@ -0,0 +1,53 @@
+// vertex.h provides the vertex stage of the rendering pipeline, which transforms and projects each of
+// a mesh's vertices once per frame.
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include "mesh.h"
+#include "vector.h"
+
+/*
+Structs
+*/
+
+// vertex_cache_t holds the vertices of a mesh projected to screen space for the current frame,
+// indexed like the mesh's vertices. Faces look up their projected vertices here, so that vertices
+// shared by several faces are transformed and projected only once. Each component is stored as its
+// own stream, and w is preserved for perspective-correct texturing and depth ordering.
+typedef struct vertex_cache_t {
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+	int capacity;
+} vertex_cache_t;
+
+/*
+Functions
+*/
+
+// Transforms the vertices of the mesh clusters at the given indices into clip space by the matrix,
+// the product of the projection, world and mesh dequantization matrices, then projects them onto the
+// screen, a batch of vertices at a time. The cached values of other vertices are left undefined.
+// The caller must first hold the cache for every vertex of the mesh with vertex_cache_hold, after
+// which disjoint sets of clusters may be updated concurrently.
+void vertex_cache_update(
+	vertex_cache_t* cache,
+	const mesh_t* mesh,
+	const int* clusters,
+	int n_clusters,
+	const mat4_t* matrix,
+	int window_width,
+	int window_height
+);
+
+// Ensures the cache has space for len vertices, discarding its contents if it must grow.
+void vertex_cache_hold(vertex_cache_t* cache, int len);
+
+// Returns the cached vertex at index i projected to screen space.
+vec4_t vertex_cache_screen(const vertex_cache_t* cache, int i);
+
+// Free the memory associated with the cache, after which it is empty.
+void vertex_cache_free(vertex_cache_t* cache);
+
+#endif